@@ -12,8 +12,23 @@ void Module::init(){
 bool Module::run(int e)
 {
     // Equivalent to BeamOn(1) 
-    run_manager_->Run(e, 1);
-    return true;
+    return run_range(e, 1).front();
+}
+
+std::vector<bool> Module::run_range(int first, int count)
+{
+    // Equivalent to BeamOn(count), seeds for all events are reserved at once
+    const auto& results = run_manager_->Run(first, count);
+
+    // Events that were never reached because the run got aborted count as failed
+    std::vector<bool> status(results.begin(), results.end());
+    status.resize(static_cast<size_t>(count), false);
+    return status;
+}
+
+bool Module::run_sub_event(int e, int slice, int slices)
+{
+    return run_manager_->RunSubEvent(e, slice, slices);
 }
 
 void Module::finializeThread()
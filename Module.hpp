@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 class SimpleMasterRunManager;
 
 class Module {
@@ -9,6 +11,13 @@ class Module {
 
         bool run(int evt_nr);
 
+        // Runs the events first ... first + count - 1 in a single run on the calling thread
+        // and returns per event whether it was simulated successfully
+        std::vector<bool> run_range(int first, int count);
+
+        // Runs slice `slice` of `slices` of the event evt_nr as a sub-event on the calling thread
+        bool run_sub_event(int evt_nr, int slice, int slices);
+
         // must be called by each thread to cleanup thread local data
         void finializeThread();
 
@@ -1,5 +1,12 @@
 #include "SimpleMasterRunManager.hpp"
 #include "SimpleWorkerRunManager.hpp"
+#include "tools/Instrumentation.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include <G4AutoLock.hh>
+#include <Randomize.hh>
 
 G4ThreadLocal SimpleWorkerRunManager* SimpleMasterRunManager::worker_run_manager_ = nullptr;
 
@@ -16,45 +23,237 @@ void SimpleMasterRunManager::Initialize()
 {
     G4MTRunManager::Initialize();
 
-    // This is needed to draw random seeds and fill the internal seed array
-    // use nSeedsMax to fill as much as possible now and hopefully avoid
-    // refilling later
-    G4MTRunManager::InitializeEventLoop(nSeedsMax, nullptr, 0);
+    if(seeding_mode_ == SeedingMode::Counter) {
+        // Draw a single 64 bit master seed from the master engine, every event
+        // seed is derived from it and the event number
+        auto high = static_cast<std::uint64_t>(G4UniformRand() * 4294967296.);
+        auto low = static_cast<std::uint64_t>(G4UniformRand() * 4294967296.);
+        counter_seeds_ = CounterSeeds((high << 32) | low);
+
+        // The event loop still needs initializing for the worker setup, but
+        // no seeds have to be drawn
+        G4MTRunManager::InitializeEventLoop(0, nullptr, 0);
+    } else {
+        // This is needed to draw random seeds and fill the internal seed array
+        // use nSeedsMax to fill as much as possible now and hopefully avoid
+        // refilling later
+        G4MTRunManager::InitializeEventLoop(nSeedsMax, nullptr, 0);
+    }
+
+    // The event loop initialization prepared the commands applied so far
+    G4AutoLock lock(&command_stack_mutex_);
+    std::vector<G4String> commands = GetCommandStack();
+    command_history_.insert(command_history_.end(), commands.begin(), commands.end());
+    command_stack_version_.store(command_history_.size(), std::memory_order_release);
+}
+
+void SimpleMasterRunManager::UpdateCommandStack()
+{
+    G4AutoLock lock(&command_stack_mutex_);
+
+    // Collect the commands applied since the last preparation
+    PrepareCommandsStack();
+    std::vector<G4String> commands = GetCommandStack();
+    if(commands.empty()) {
+        return;
+    }
+
+    command_history_.insert(command_history_.end(), commands.begin(), commands.end());
+    command_stack_version_.store(command_history_.size(), std::memory_order_release);
+}
+
+std::size_t SimpleMasterRunManager::GetCommandsSince(std::size_t version, std::vector<G4String>& commands) const
+{
+    G4AutoLock lock(&command_stack_mutex_);
+    commands.insert(commands.end(), command_history_.begin() + static_cast<std::ptrdiff_t>(version), command_history_.end());
+    return command_history_.size();
+}
+
+void SimpleMasterRunManager::RunTermination()
+{
+    numberOfEventProcessed = events_dispatched_;
+    G4MTRunManager::RunTermination();
+}
+
+void SimpleMasterRunManager::CreateWorkerForThread()
+{
+    auto start = std::chrono::steady_clock::now();
+    worker_run_manager_ = SimpleWorkerRunManager::GetNewInstanceForThread();
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    RegisterWorker(worker_run_manager_);
+
+    G4AutoLock lock(&init_times_mutex_);
+    worker_init_times_.push_back({G4Threading::G4GetThreadId(), duration.count()});
+}
+
+void SimpleMasterRunManager::WarmUp(ThreadPool& pool)
+{
+    // Every pool thread builds its own worker, all of them at the same time
+    pool.for_each_thread([this]() {
+        if (!worker_run_manager_) {
+            CreateWorkerForThread();
+        }
+    });
+}
+
+std::vector<SimpleMasterRunManager::WorkerInitTime> SimpleMasterRunManager::GetWorkerInitTimes() const
+{
+    G4AutoLock lock(&init_times_mutex_);
+    return worker_init_times_;
+}
+
+std::vector<SimpleMasterRunManager::WorkerInfo> SimpleMasterRunManager::GetWorkers() const
+{
+    G4AutoLock lock(&workers_mutex_);
+    std::vector<WorkerInfo> workers;
+    workers.reserve(workers_.size());
+    for(const SimpleWorkerRunManager* worker : workers_) {
+        workers.push_back({worker->thread_id_, worker->host_thread_,
+                           static_cast<WorkerState>(worker->state_.load(std::memory_order_relaxed)),
+                           worker->events_processed_.load(std::memory_order_relaxed),
+                           static_cast<double>(worker->busy_nanoseconds_.load(std::memory_order_relaxed)) * 1e-9});
+    }
+    return workers;
+}
+
+std::size_t SimpleMasterRunManager::GetNumberOfWorkers() const
+{
+    G4AutoLock lock(&workers_mutex_);
+    return workers_.size();
+}
+
+void SimpleMasterRunManager::RegisterWorker(SimpleWorkerRunManager* worker)
+{
+    G4AutoLock lock(&workers_mutex_);
+    workers_.push_back(worker);
+}
+
+void SimpleMasterRunManager::UnregisterWorker(SimpleWorkerRunManager* worker)
+{
+    G4AutoLock lock(&workers_mutex_);
+    workers_.erase(std::remove(workers_.begin(), workers_.end(), worker), workers_.end());
 }
 
 void SimpleMasterRunManager::TerminateForThread()
 {
-    worker_run_manager_->RunTermination();
+    // Threads added by ThreadPool::resize can retire before they ever received an event
+    if(!worker_run_manager_) {
+        return;
+    }
+    if(worker_run_manager_->IsStreaming()) {
+        worker_run_manager_->EndStream();
+    } else {
+        worker_run_manager_->RunTermination();
+    }
+
+    // The master must not see the worker anymore once it is being destroyed
+    UnregisterWorker(worker_run_manager_);
     delete worker_run_manager_;
     worker_run_manager_ = nullptr;
 }
 
-void SimpleMasterRunManager::Run(G4int i_event, G4int n_event)
+std::size_t SimpleMasterRunManager::TerminateAllWorkers(ThreadPool& pool)
 {
-    if (!worker_run_manager_) {
-        worker_run_manager_ = SimpleWorkerRunManager::GetNewInstanceForThread();
+    pool.for_each_thread([this]() { TerminateForThread(); });
+    return GetNumberOfWorkers();
+}
+
+void SimpleMasterRunManager::ParkForThread()
+{
+    if(!worker_run_manager_) {
+        return;
     }
+    worker_run_manager_->EndStream();
+    worker_run_manager_->state_.store(static_cast<int>(WorkerState::Parked), std::memory_order_relaxed);
+}
 
-    // the allpix event number, do we need it?
-    worker_run_manager_->currEvID = i_event;
+void SimpleMasterRunManager::ReserveSeeds(SimpleWorkerRunManager* worker, G4int n_event)
+{
+    // Pairs left over from a batch whose run ended early must not seed the events of this batch
+    while(!worker->seedsQueue.empty()) {
+        worker->seedsQueue.pop();
+    }
 
-    // seed the run here first before we run on a seperate thread.
+    // Any pool thread can get here, the seed array and its cursor are shared
+    G4AutoLock lock(&seeds_mutex_);
     G4RNGHelper* helper = G4RNGHelper::GetInstance();
 
-    G4int idx_rndm = nSeedsPerEvent*nSeedsUsed;
-    long s1 = helper->GetSeed(idx_rndm), s2 = helper->GetSeed(idx_rndm+1);
-    worker_run_manager_->seedsQueue.push(s1);
-    worker_run_manager_->seedsQueue.push(s2);
-    G4cout << "SetUpAnEvent s1=" << s1 << " s2=" << s2 << G4endl;
+    for(G4int i = 0; i < n_event; ++i) {
+        G4int idx_rndm = nSeedsPerEvent*nSeedsUsed;
+        long s1 = helper->GetSeed(idx_rndm), s2 = helper->GetSeed(idx_rndm+1);
+        worker->seedsQueue.push(s1);
+        worker->seedsQueue.push(s2);
+        if(verboseLevel > 1) {
+            G4cout << "SetUpAnEvent s1=" << s1 << " s2=" << s2 << G4endl;
+        }
+
+        nSeedsUsed++;
+        if(nSeedsUsed==nSeedsFilled) {
+            // The RefillSeeds call will refill the array with 1024 new entries
+            numberOfEventToBeProcessed = nSeedsFilled + 1024;
+            RefillSeeds();
+        }
+    }
+}
+
+G4bool SimpleMasterRunManager::RunSubEvent(G4int i_event, G4int i_slice, G4int n_slices)
+{
+    if(seeding_mode_ != SeedingMode::Counter) {
+        G4Exception("SimpleMasterRunManager::RunSubEvent()", "Run0035", FatalException,
+                "Sub-events require the counter seeding mode!");
+        return false;
+    }
 
-    nSeedsUsed++;
-    if(nSeedsUsed==nSeedsFilled) {
-        // The RefillSeeds call will refill the array with 1024 new entries
-        numberOfEventToBeProcessed = nSeedsFilled + 1024;
-        RefillSeeds();
+    SubEventScope slice(i_event, static_cast<std::uint32_t>(i_slice), static_cast<std::uint32_t>(n_slices));
+    const auto& results = Run(i_event, 1);
+    return !results.empty() && results.front();
+}
+
+const std::vector<G4bool>& SimpleMasterRunManager::Run(G4int i_event, G4int n_event)
+{
+    if (!worker_run_manager_) {
+        CreateWorkerForThread();
     }
 
-    numberOfEventProcessed += n_event;
+    auto start = std::chrono::steady_clock::now();
+    worker_run_manager_->state_.store(static_cast<int>(WorkerState::Busy), std::memory_order_relaxed);
 
-    worker_run_manager_->BeamOn(n_event);
-}
\ No newline at end of file
+    // Events of the batch are numbered consecutively from the host event number
+    worker_run_manager_->next_event_id_ = i_event;
+    worker_run_manager_->event_results_.clear();
+
+    // seed all events of the batch here first before we run on a seperate thread.
+    // In counter mode the worker derives the seeds itself from the event number.
+    if(seeding_mode_ == SeedingMode::Queue) {
+        INSTRUMENT_SCOPE(SeedDispensing);
+        ReserveSeeds(worker_run_manager_, n_event);
+    }
+
+    events_dispatched_.fetch_add(n_event, std::memory_order_relaxed);
+
+    if(streaming_mode_) {
+        // Events go into the run kept open by the worker, it is reopened if a
+        // previous event aborted it
+        for(G4int i = 0; i < n_event; ++i) {
+            if(!worker_run_manager_->IsStreaming()) {
+                worker_run_manager_->BeginStream();
+            }
+            worker_run_manager_->ProcessStreamedEvent();
+        }
+    } else {
+        // A single run processes the whole batch
+        worker_run_manager_->BeamOn(n_event);
+    }
+
+    // Only this thread writes the statistics of its worker and the master merely reads them,
+    // so a relaxed load and store suffices instead of a locked read-modify-write
+    auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    auto& busy_nanoseconds = worker_run_manager_->busy_nanoseconds_;
+    busy_nanoseconds.store(busy_nanoseconds.load(std::memory_order_relaxed) + busy.count(), std::memory_order_relaxed);
+    auto& events_processed = worker_run_manager_->events_processed_;
+    events_processed.store(events_processed.load(std::memory_order_relaxed) +
+                           static_cast<G4int>(worker_run_manager_->event_results_.size()), std::memory_order_relaxed);
+    worker_run_manager_->state_.store(static_cast<int>(WorkerState::Idle), std::memory_order_relaxed);
+
+    return worker_run_manager_->event_results_;
+}
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <G4MTRunManager.hh>
+#include <G4Threading.hh>
+
+#include "simulation/tally.hpp"
+#include "tools/CounterSeeds.hpp"
+#include "tools/SubEvent.hpp"
+#include "tools/ThreadPool.hpp"
 
 class SimpleWorkerRunManager;
 
@@ -11,20 +21,128 @@ class SimpleWorkerRunManager;
 class SimpleMasterRunManager : public G4MTRunManager {
     friend class SimpleWorkerRunManager;
 public:
+    // Time it took to create and initialize the worker of a thread
+    struct WorkerInitTime {
+        G4int thread_id;
+        double seconds;
+    };
+
+    // What a registered worker is doing, as seen by the master
+    enum class WorkerState {
+        // Waiting for the next call to Run on its thread
+        Idle,
+        // Simulating events
+        Busy,
+        // No run open, kept for the next time its host thread calls Run
+        Parked
+    };
+
+    // Snapshot of a registered worker
+    struct WorkerInfo {
+        G4int thread_id;
+        std::thread::id host_thread;
+        WorkerState state;
+        G4int events_processed;
+        double busy_seconds;
+    };
+
+    // How the seeds of each event are determined
+    enum class SeedingMode {
+        // Seeds are drawn from the master engine and handed out in call order
+        Queue,
+        // Seeds are a pure function of the master seed and the event number
+        Counter
+    };
+
     SimpleMasterRunManager();
     virtual ~SimpleMasterRunManager();
 
+    // In streaming mode every worker keeps a single run open and simulates the
+    // events it receives one by one inside it. The run is closed by TerminateForThread.
+    void SetStreamingMode(G4bool streaming) { streaming_mode_ = streaming; }
+    G4bool GetStreamingMode() const { return streaming_mode_; }
+
+    // Select how events are seeded, must be called before Initialize
+    void SetSeedingMode(SeedingMode mode) { seeding_mode_ = mode; }
+    SeedingMode GetSeedingMode() const { return seeding_mode_; }
+
+    // Seed generator used in counter mode, valid after Initialize
+    const CounterSeeds& GetCounterSeeds() const { return counter_seeds_; }
+
+    // Stream of the counter seeds used by sub-events, the events themselves use stream 0
+    static constexpr std::uint32_t sub_event_stream = 2;
+
     // Reimplemented to initialize the event loop with max number of events
     virtual void Initialize() override;
 
+    // Publish the UI commands applied on the master since the last call to the
+    // workers. Called by Initialize, call it again from the master thread after
+    // applying further commands meant for the workers.
+    void UpdateCommandStack();
+
+    // Version of the published command stack, it grows with every published command
+    std::size_t GetCommandStackVersion() const {
+        return command_stack_version_.load(std::memory_order_acquire);
+    }
+
+    // Append the commands published after the given version to commands and
+    // return the version they bring the caller to
+    std::size_t GetCommandsSince(std::size_t version, std::vector<G4String>& commands) const;
+
+    // Reimplemented to report the number of events dispatched to the workers
+    virtual void RunTermination() override;
+
     // Wrapper around BeamOn. It doesn't actually call BeamOn of this manager
     // but rather of the thread specific manager managed internall by this 
     // object.
-    void Run(G4int i_event, G4int n_event);
+    // Simulates the events i_event ... i_event + n_event - 1 within a single run
+    // of the worker and returns for each of them whether it completed without
+    // being aborted. The returned vector is owned by the calling thread's worker
+    // and is valid until its next call to Run.
+    const std::vector<G4bool>& Run(G4int i_event, G4int n_event);
+
+    // Simulates slice i_slice of n_slices of the logical event i_event as an
+    // event of its own on the calling thread's worker. The primary generator
+    // and the hit collection see the slice through SubEventSlice::current(),
+    // the seeds are derived from the event number and the slice index, so the
+    // sub-events can run on any thread in any order. Requires counter seeding.
+    // Returns whether the sub-event completed without being aborted.
+    G4bool RunSubEvent(G4int i_event, G4int i_slice, G4int n_slices);
+
+    // Create the workers of all pool threads concurrently before the event
+    // loop starts, instead of lazily on the first event each thread receives.
+    // Must be called after Initialize and not from a pool thread.
+    void WarmUp(ThreadPool& pool);
+
+    // Initialization time of every worker created so far
+    std::vector<WorkerInitTime> GetWorkerInitTimes() const;
+
+    // State and statistics of all live workers, safe to call from any thread
+    // while the workers are running
+    std::vector<WorkerInfo> GetWorkers() const;
+
+    // Number of live workers
+    std::size_t GetNumberOfWorkers() const;
+
+    // Merge the run tallies of all workers, including terminated ones. Can be
+    // called while the workers keep simulating events.
+    RunSummary GetRunSummary() const { return RunTally::Merge(); }
 
     // Must be called by each custom thread that ever called the Run method
     // to clean thread local stuff
     void TerminateForThread();
+
+    // Terminate the workers of all pool threads, driven from the master thread.
+    // Geant4 keeps the state of a worker in thread local storage, so every
+    // worker is still destroyed on its own thread. Returns the number of workers
+    // left, those of threads outside the pool. Not to be called from a pool thread.
+    std::size_t TerminateAllWorkers(ThreadPool& pool);
+
+    // Close the run of the calling thread's worker but keep the worker. The next
+    // call to Run on the same thread picks it up without initializing a new one,
+    // so host frameworks recycling their threads between jobs call this instead
+    // of TerminateForThread.
+    void ParkForThread();
 protected:
     // Original G4MTRunManager API
     // All methods are overriden to do nothing
@@ -53,6 +171,40 @@ protected:
     virtual void WaitForEndEventLoopWorkers() override {}
     virtual void WaitForReadyWorkers() override {}
 private:
+    // Create the worker of the calling thread and record its initialization time
+    void CreateWorkerForThread();
+
+    // Reserve the seeds of n_event consecutive events for the given worker
+    void ReserveSeeds(SimpleWorkerRunManager* worker, G4int n_event);
+
+    // Add the worker of the calling thread to or remove it from the registry
+    void RegisterWorker(SimpleWorkerRunManager* worker);
+    void UnregisterWorker(SimpleWorkerRunManager* worker);
+
+    G4bool streaming_mode_{false};
+
+    SeedingMode seeding_mode_{SeedingMode::Queue};
+    CounterSeeds counter_seeds_;
+
+    // Protects the seed array and its cursor in queue mode
+    G4Mutex seeds_mutex_;
+
+    // Initialization time of all created workers
+    mutable G4Mutex init_times_mutex_;
+    std::vector<WorkerInitTime> worker_init_times_;
+
+    // All live workers, a worker leaves the registry before it is destroyed
+    mutable G4Mutex workers_mutex_;
+    std::vector<SimpleWorkerRunManager*> workers_;
+
+    // All commands published to the workers, the version is the number of commands
+    mutable G4Mutex command_stack_mutex_;
+    std::vector<G4String> command_history_;
+    std::atomic<std::size_t> command_stack_version_{0};
+
+    // Number of events handed to workers from any thread
+    std::atomic<G4int> events_dispatched_{0};
+
     // Worker manager that carry out the actual work. It is allocated
     // on a per thread basis
     static G4ThreadLocal SimpleWorkerRunManager* worker_run_manager_; 
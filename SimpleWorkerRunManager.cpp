@@ -1,4 +1,7 @@
 #include "SimpleWorkerRunManager.hpp"
+#include "SimpleMasterRunManager.hpp"
+#include "tools/Instrumentation.hpp"
+#include "simulation/tally.hpp"
 #include <G4Run.hh>
 #include <G4MTRunManager.hh>
 #include <G4UserWorkerInitialization.hh>
@@ -18,9 +21,32 @@
 #include <G4UserWorkerInitialization.hh>
 #include <G4VUserActionInitialization.hh>
 
-#include <atomic>
+#include <limits>
+#include <mutex>
+#include <set>
 
-static std::atomic<int> counter;
+// Geant4 thread ids of terminated workers are handed out again, so the ids stay below the
+// largest number of workers alive at once however often pool threads are replaced
+static std::mutex thread_ids_mutex;
+static std::set<G4int> free_thread_ids;
+static G4int next_thread_id = 0;
+
+static G4int AcquireThreadId()
+{
+    std::lock_guard<std::mutex> lock(thread_ids_mutex);
+    if(free_thread_ids.empty()) {
+        return next_thread_id++;
+    }
+    G4int id = *free_thread_ids.begin();
+    free_thread_ids.erase(free_thread_ids.begin());
+    return id;
+}
+
+static void ReleaseThreadId(G4int id)
+{
+    std::lock_guard<std::mutex> lock(thread_ids_mutex);
+    free_thread_ids.insert(id);
+}
 
 SimpleWorkerRunManager::SimpleWorkerRunManager() :
     G4WorkerRunManager()
@@ -43,12 +69,23 @@ SimpleWorkerRunManager::~SimpleWorkerRunManager()
     //===============================
     // TODO: crashes! is it needed anyways?
     //G4WorkerThread::DestroyGeometryAndPhysicsVector();
+
+    // A worker created later on another thread can take over the id
+    ReleaseThreadId(thread_id_);
 }
 
 void SimpleWorkerRunManager::BeamOn(G4int n_event,const char* macroFile,G4int n_select)
 {
-    G4MTRunManager* mrm = G4MTRunManager::GetMasterRunManager();
+    {
+        INSTRUMENT_SCOPE(RunPreparation);
+        PrepareRun();
+    }
+
+    G4RunManager::BeamOn(n_event, macroFile, n_select);
+}
 
+void SimpleWorkerRunManager::PrepareRun()
+{
     // G4Comment: The following code deals with changing materials between runs
     // While we don't really change materials between runs, but this is here
     // for completeness.
@@ -64,18 +101,94 @@ void SimpleWorkerRunManager::BeamOn(G4int n_event,const char* macroFile,G4int n_
     }
 
     // G4Comment: Execute UI commands stored in the master UI manager
-    std::vector<G4String> cmds = mrm->GetCommandStack();
-    G4UImanager* uimgr = G4UImanager::GetUIpointer(); //TLS instance
-    std::vector<G4String>::const_iterator it = cmds.begin();
-    for(;it!=cmds.end();it++)
-    { uimgr->ApplyCommand(*it); }
+    // Only commands this worker has not seen yet are applied
+    ApplyNewCommands();
+}
 
-    G4RunManager::BeamOn(n_event, macroFile, n_select);
+void SimpleWorkerRunManager::BeginStream()
+{
+    {
+        INSTRUMENT_SCOPE(RunPreparation);
+        PrepareRun();
+    }
+
+    // Same as G4RunManager::BeamOn, except that the run is left open and has
+    // no predefined number of events
+    fakeRun = false;
+    if(!ConfirmBeamOnCondition()) {
+        G4Exception("SimpleWorkerRunManager::BeginStream()", "Run0031", FatalException,
+                "Worker is not ready to start a run!");
+    }
+    numberOfEventToBeProcessed = std::numeric_limits<G4int>::max();
+    numberOfEventProcessed = 0;
+    ConstructScoringWorlds();
+    RunInitialization();
+
+    InitializeEventLoop(numberOfEventToBeProcessed, nullptr, -1);
+    runIsSeeded = true;
+    eventLoopOnGoing = true;
+    nevModulo = -1;
+    currEvID = -1;
+
+    streaming_ = true;
+}
+
+G4bool SimpleWorkerRunManager::ProcessStreamedEvent()
+{
+    // The UI commands can change between events, checking the version is cheap
+    ApplyNewCommands();
+
+    std::size_t n_results = event_results_.size();
+    ProcessOneEvent(-1);
+    if(!eventLoopOnGoing) {
+        // The run cannot take further events, start a new one for the next event
+        EndStream();
+        return false;
+    }
+    TerminateOneEvent();
+
+    if(runAborted) {
+        EndStream();
+    }
+    return event_results_.size() > n_results && event_results_.back();
+}
+
+void SimpleWorkerRunManager::EndStream()
+{
+    if(!streaming_) {
+        return;
+    }
+
+    eventLoopOnGoing = false;
+    TerminateEventLoop();
+    RunTermination();
+    streaming_ = false;
+}
+
+void SimpleWorkerRunManager::ApplyNewCommands(G4bool echo)
+{
+    auto mrm = static_cast<SimpleMasterRunManager*>(G4MTRunManager::GetMasterRunManager());
+    if(mrm->GetCommandStackVersion() == command_stack_version_) {
+        return;
+    }
+
+    std::vector<G4String> cmds;
+    command_stack_version_ = mrm->GetCommandsSince(command_stack_version_, cmds);
+
+    G4UImanager* uimgr = G4UImanager::GetUIpointer(); //TLS instance
+    for(const auto& cmd : cmds)
+    {
+        if(echo) {
+            G4cout << cmd << G4endl;
+        }
+        uimgr->ApplyCommand(cmd);
+    }
 }
 
 G4Event* SimpleWorkerRunManager::GenerateEvent(G4int i_event)
 {
     (void)i_event;
+    INSTRUMENT_SCOPE(GenerateEvent);
     if(!userPrimaryGeneratorAction)
     {
         G4Exception("SimpleWorkerRunManager::GenerateEvent()", "Run0032", FatalException,
@@ -88,15 +201,32 @@ G4Event* SimpleWorkerRunManager::GenerateEvent(G4int i_event)
     s1 = s2 = s3 = 0;
 
     if( numberOfEventProcessed < numberOfEventToBeProcessed && !runAborted ) {
-        anEvent  = new G4Event(numberOfEventProcessed);
-
-        // Seeds are stored in this queue to ensure we can reproduce the results of events
-        // each event will reseed the random number generator
-        s1 = seedsQueue.front(); seedsQueue.pop();
-        s2 = seedsQueue.front(); seedsQueue.pop();
-        if (seedsQueue.size() > 0) {
-            G4Exception("SimpleWorkerRunManager::GenerateEvent()", "Run0032", FatalException,
-            "SeedsQueue should be empty!");
+        G4int event_id = next_event_id_++;
+        anEvent  = new G4Event(event_id);
+
+        auto master_run_manager = static_cast<SimpleMasterRunManager*>(G4MTRunManager::GetMasterRunManager());
+        if (master_run_manager->GetSeedingMode() == SimpleMasterRunManager::SeedingMode::Counter) {
+            // Seeds only depend on the event number, no shared state is touched
+            const CounterSeeds& seeds = master_run_manager->GetCounterSeeds();
+            const SubEventSlice& slice = SubEventSlice::current();
+            if (slice.active) {
+                // Every slice of the logical event gets its own pair of seeds
+                s1 = seeds.seed(event_id, 2 * slice.index, SimpleMasterRunManager::sub_event_stream);
+                s2 = seeds.seed(event_id, 2 * slice.index + 1, SimpleMasterRunManager::sub_event_stream);
+            } else {
+                s1 = seeds.seed(event_id, 0);
+                s2 = seeds.seed(event_id, 1);
+            }
+        } else {
+            // Seeds are stored in this queue to ensure we can reproduce the results of events
+            // each event will reseed the random number generator. The master pushes one
+            // pair per event of the batch.
+            if (seedsQueue.size() < 2) {
+                G4Exception("SimpleWorkerRunManager::GenerateEvent()", "Run0032", FatalException,
+                "SeedsQueue has no seeds left for this event!");
+            }
+            s1 = seedsQueue.front(); seedsQueue.pop();
+            s2 = seedsQueue.front(); seedsQueue.pop();
         }
 
         // seed RNG for this event run
@@ -114,6 +244,38 @@ G4Event* SimpleWorkerRunManager::GenerateEvent(G4int i_event)
   return anEvent;
 }
 
+void SimpleWorkerRunManager::TerminateOneEvent()
+{
+    INSTRUMENT_SCOPE(TerminateOneEvent);
+    INSTRUMENT_EVENT();
+    event_results_.push_back(!currentEvent->IsAborted());
+    G4WorkerRunManager::TerminateOneEvent();
+}
+
+void SimpleWorkerRunManager::ProcessOneEvent(G4int i_event)
+{
+    INSTRUMENT_SCOPE(ProcessOneEvent);
+    G4WorkerRunManager::ProcessOneEvent(i_event);
+}
+
+void SimpleWorkerRunManager::RunInitialization()
+{
+    INSTRUMENT_SCOPE(RunInitialization);
+    G4WorkerRunManager::RunInitialization();
+}
+
+void SimpleWorkerRunManager::RunTermination()
+{
+    INSTRUMENT_SCOPE(RunTermination);
+    G4WorkerRunManager::RunTermination();
+}
+
+void SimpleWorkerRunManager::MergePartialResults()
+{
+    // Nothing is handed to the master here, so no lock is taken at the end of every run
+    RunTally::AddRun();
+}
+
 void SimpleWorkerRunManager::DoEventLoop(G4int n_event,const char* macroFile,G4int n_select)
 {
     if(!userPrimaryGeneratorAction)
@@ -159,7 +321,7 @@ SimpleWorkerRunManager* SimpleWorkerRunManager::GetNewInstanceForThread()
     //Initliazie per-thread stream-output
     //The following line is needed before we actually do I/O initialization
     //because the constructor of UI manager resets the I/O destination.
-    G4int thisId = counter.fetch_add(1);
+    G4int thisId = AcquireThreadId();
     G4Threading::G4SetThreadId( thisId );
     G4UImanager::GetUIpointer()->SetUpForAThread( thisId );
 
@@ -183,6 +345,7 @@ SimpleWorkerRunManager* SimpleWorkerRunManager::GetNewInstanceForThread()
     //Now initialize worker part of shared objects (geometry/physics)
     G4WorkerThread::BuildGeometryAndPhysicsVector();
     thread_run_manager = new SimpleWorkerRunManager;
+    thread_run_manager->thread_id_ = thisId;
 
     //================================
     //Step-3: Setup worker run manager
@@ -208,14 +371,7 @@ SimpleWorkerRunManager* SimpleWorkerRunManager::GetNewInstanceForThread()
     thread_run_manager->Initialize();
 
     // Execute UI commands stored in the masther UI manager
-    std::vector<G4String> cmds = master_run_manager->GetCommandStack();
-    G4UImanager* uimgr = G4UImanager::GetUIpointer(); //TLS instance
-    std::vector<G4String>::const_iterator it = cmds.begin();
-    for(;it!=cmds.end();it++)
-    { 
-        G4cout << *it << G4endl;
-        uimgr->ApplyCommand(*it);
-    }
+    thread_run_manager->ApplyNewCommands(true);
 
     return thread_run_manager;
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
 #include <G4WorkerRunManager.hh>
 
 class SimpleMasterRunManager;
@@ -18,12 +23,41 @@ public:
     // Factory method to create and correctly initialize a new worker
     static SimpleWorkerRunManager* GetNewInstanceForThread();
 
+    // Streaming mode: open a run that stays open while events are processed one
+    // at a time by ProcessStreamedEvent, until EndStream closes it.
+    void BeginStream();
+
+    // Simulate the next event within the open run. Returns whether the event
+    // completed without being aborted.
+    G4bool ProcessStreamedEvent();
+
+    // Close the run opened by BeginStream
+    void EndStream();
+
+    G4bool IsStreaming() const { return streaming_; }
+
 protected:
     SimpleWorkerRunManager();
 
     // Needed to construct a new Event
     virtual G4Event* GenerateEvent(G4int i_event) override;
 
+    // Records the outcome of the event before it is stacked
+    virtual void TerminateOneEvent() override;
+
+    // The following only add instrumentation timers around the base implementation
+    virtual void ProcessOneEvent(G4int i_event) override;
+    virtual void RunInitialization() override;
+    virtual void RunTermination() override;
+
+    // Update the geometry and physics from the master and apply new UI commands
+    // before a run is started
+    void PrepareRun();
+
+    // Apply the UI commands the master published since this worker last applied
+    // commands. Does nothing without copying when no new commands exist.
+    void ApplyNewCommands(G4bool echo = false);
+
     // The only difference from G4WorkerRunManager's BeamOn is that the seedsQueue is never
     // emptied since the master will populate it with the needed seeds.
     virtual void DoEventLoop(G4int n_event,const char* macroFile=0,G4int n_select=-1) override;
@@ -31,6 +65,32 @@ protected:
     // We have no work from Master to do
     virtual void DoWork() override {}
 
-    // We don't need to merge the results
-    virtual void MergePartialResults() override {}
+    // Count the finished run in the run tally of this thread, the tallies of all
+    // threads are only merged on demand by the master
+    virtual void MergePartialResults() override;
+
+private:
+    // Geant4 thread id of the thread owning this worker, released when the worker is destroyed
+    G4int thread_id_{0};
+
+    // Host thread owning this worker
+    std::thread::id host_thread_{std::this_thread::get_id()};
+
+    // Statistics read by the master registry, only written by the owning thread.
+    // The state holds a SimpleMasterRunManager::WorkerState.
+    std::atomic<int> state_{0};
+    std::atomic<G4int> events_processed_{0};
+    std::atomic<std::int64_t> busy_nanoseconds_{0};
+
+    // Version of the master command stack this worker has applied
+    std::size_t command_stack_version_{0};
+
+    // Whether a run is kept open for streamed events
+    G4bool streaming_{false};
+
+    // Event number given to the next generated event, set by the master per batch
+    G4int next_event_id_{0};
+
+    // Whether each event of the current batch completed without being aborted
+    std::vector<G4bool> event_results_;
 };
@@ -0,0 +1,592 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "simulation/geometry.hpp"
+#include "simulation/generator.hpp"
+#include "simulation/physicscache.hpp"
+#include "tools/CountdownLatch.hpp"
+#include "tools/ThreadPool.hpp"
+
+#include <G4RunManager.hh>
+#include <G4MTRunManager.hh>
+#include <G4StepLimiterPhysics.hh>
+#include <G4PhysListFactory.hh>
+#include <G4UImanager.hh>
+#include <G4UserEventAction.hh>
+#include <G4UserSteppingAction.hh>
+
+#include "Module.hpp"
+#include "SimpleMasterRunManager.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+    /**
+     * @brief Records the processing time of every event on the thread executing it
+     *
+     * Every worker builds its own instance. The latencies are kept in a shared buffer so they can be collected after
+     * the event loop, even when the worker has already been destroyed.
+     */
+    class EventTimingAction : public G4UserEventAction {
+    public:
+        EventTimingAction() : latencies_(std::make_shared<std::vector<double>>()) {
+            std::lock_guard<std::mutex> lock{registry_mutex()};
+            registry().push_back(latencies_);
+        }
+
+        void BeginOfEventAction(const G4Event*) override { start_ = Clock::now(); }
+
+        void EndOfEventAction(const G4Event*) override {
+            latencies_->push_back(std::chrono::duration<double>(Clock::now() - start_).count());
+        }
+
+        /**
+         * @brief Collect the latencies of all workers, must only be called while no events are processed
+         */
+        static std::vector<double> collect() {
+            std::lock_guard<std::mutex> lock{registry_mutex()};
+            std::vector<double> all;
+            for(const auto& latencies : registry()) {
+                all.insert(all.end(), latencies->begin(), latencies->end());
+            }
+            return all;
+        }
+
+    private:
+        static std::mutex& registry_mutex() {
+            static std::mutex mutex;
+            return mutex;
+        }
+        static std::vector<std::shared_ptr<std::vector<double>>>& registry() {
+            static std::vector<std::shared_ptr<std::vector<double>>> latencies;
+            return latencies;
+        }
+
+        std::shared_ptr<std::vector<double>> latencies_;
+        Clock::time_point start_;
+    };
+
+    /**
+     * @brief Builds the particle source and the event timing for every worker
+     */
+    class BenchActionInitialization : public GeneratorActionInitialization {
+    public:
+        BenchActionInitialization(double energy, bool profile, std::size_t presample, bool gun, const PolicyConfig& policy,
+                                  bool sequential)
+            : GeneratorActionInitialization(energy) {
+            SetSteppingProfiler(profile);
+            SetBeamGun(gun);
+            // The same primaries in every execution model: all of them number the events 0 ... events - 1, the
+            // sequential run manager restarts the event ID with every BeamOn and counts the events instead
+            SetPresampling(presample, primary_seed);
+            SetPresampledEventCounting(sequential);
+            SetPerformancePolicy(policy);
+            SetStepCounting(true);
+        }
+
+        static constexpr std::uint64_t primary_seed = 1;
+
+        void Build() const override {
+            GeneratorActionInitialization::Build();
+            SetUserAction(new EventTimingAction());
+        }
+    };
+
+    /**
+     * @brief Parameters of a single benchmark run
+     */
+    struct BenchConfig {
+        std::string mode;
+        int threads;
+        int events;
+        double energy;
+        int batch;
+        bool stream;
+        std::string placement;
+        bool profile;
+        std::size_t presample;
+        bool gun;
+        int planes;
+        std::string plane_placement;
+        // Smartless values of logical volumes as "volume=value,...", empty keeps the Geant4 default
+        std::string smartless;
+        double pitch;
+        double pixel_pitch;
+        double world_cut;
+        double sensor_cut;
+        PolicyConfig policy;
+        // Physics table cache directory, empty to always build the tables
+        std::string physics_cache;
+    };
+
+    /**
+     * @brief Measurements of a single benchmark run
+     */
+    struct BenchResult {
+        double init_seconds;
+        double loop_seconds;
+        std::vector<double> latencies;
+        std::uint64_t steps;
+        std::uint64_t hits;
+        // "hit" if the physics tables were retrieved from the cache, "miss" if they were built and stored
+        std::string physics_cache;
+    };
+
+    // Geometry, physics, particle source and seeds, the same for all execution models. Returns the
+    // physics table cache if one is configured.
+    template <typename RunManager>
+    std::unique_ptr<PhysicsTableCache> setup_run_manager(RunManager* run_manager, const BenchConfig& config) {
+        GeometryConfig geometry;
+        geometry.planes = config.planes;
+        geometry.pitch = config.pitch;
+        geometry.placement = GeometryConfig::parse_placement(config.plane_placement);
+        geometry.smartless = GeometryConfig::parse_smartless(config.smartless);
+        geometry.pixel_pitch = config.pixel_pitch;
+        geometry.sensor_cut = config.sensor_cut;
+        run_manager->SetUserInitialization(new GeometryConstructionG4(geometry));
+        run_manager->InitializeGeometry();
+
+        G4PhysListFactory physListFactory;
+        G4VModularPhysicsList* physicsList = physListFactory.GetReferencePhysList("FTFP_BERT_EMZ");
+        physicsList->RegisterPhysics(new G4StepLimiterPhysics());
+        if(config.world_cut > 0) {
+            physicsList->SetDefaultCutValue(config.world_cut);
+        }
+        run_manager->SetUserInitialization(physicsList);
+        run_manager->InitializePhysics();
+        std::unique_ptr<PhysicsTableCache> physics_cache;
+        if(!config.physics_cache.empty()) {
+            physics_cache = std::make_unique<PhysicsTableCache>(config.physics_cache, "FTFP_BERT_EMZ", physicsList);
+        }
+
+        PolicyConfig policy = config.policy;
+        std::tie(policy.sensor_low, policy.sensor_high) = GeometryConstructionG4::SensorBounds(geometry);
+        run_manager->SetUserInitialization(
+            new BenchActionInitialization(config.energy, config.profile, config.presample, config.gun, policy,
+                                          config.mode == "nomt"));
+
+        std::string seed_command = "/random/setSeeds";
+        for(int i = 0; i < 10; ++i) {
+            seed_command += " " + std::to_string(i);
+        }
+        G4UImanager::GetUIpointer()->ApplyCommand(seed_command);
+        return physics_cache;
+    }
+
+    double seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Store the physics tables on a cache miss and record whether the cache was hit, the tables must have been built.
+    // The startup time is taken from just before Initialize. It is labelled with the mode and, for g4mt whose Initialize
+    // starts the workers, the number of threads, so a saving is only reported against the same kind of startup.
+    void finish_physics_cache(PhysicsTableCache* physics_cache, const BenchConfig& config, Clock::time_point start,
+                              BenchResult& result) {
+        if(physics_cache != nullptr) {
+            std::string startup = "g4-bench " + config.mode;
+            if(config.mode == "g4mt") {
+                startup += " with " + std::to_string(config.threads) + " thread(s)";
+            }
+            physics_cache->Finish(seconds_since(start), startup, std::cerr);
+            result.physics_cache = (physics_cache->Retrieved() ? "hit" : "miss");
+        }
+    }
+
+    // Sequential G4RunManager running one event per BeamOn, as g4-test-nomt
+    BenchResult run_nomt(const BenchConfig& config) {
+        BenchResult result{};
+        auto start = Clock::now();
+        auto run_manager = std::make_unique<G4RunManager>();
+        auto physics_cache = setup_run_manager(run_manager.get(), config);
+        auto init_start = Clock::now();
+        run_manager->Initialize();
+        if(physics_cache) {
+            // The sequential run manager only builds the physics tables in its first run
+            run_manager->BeamOn(0);
+            finish_physics_cache(physics_cache.get(), config, init_start, result);
+        }
+        result.init_seconds = seconds_since(start);
+
+        start = Clock::now();
+        for(int i = 0; i < config.events; ++i) {
+            run_manager->BeamOn(1);
+        }
+        result.loop_seconds = seconds_since(start);
+        result.latencies = EventTimingAction::collect();
+        return result;
+    }
+
+    // G4MTRunManager distributing all events over its own threads, as g4-test-g4mt
+    BenchResult run_g4mt(const BenchConfig& config) {
+        BenchResult result{};
+        auto start = Clock::now();
+        auto run_manager = std::make_unique<G4MTRunManager>();
+        run_manager->SetNumberOfThreads(config.threads);
+        auto physics_cache = setup_run_manager(run_manager.get(), config);
+        auto init_start = Clock::now();
+        // Also starts and initializes the worker threads
+        run_manager->Initialize();
+        finish_physics_cache(physics_cache.get(), config, init_start, result);
+        result.init_seconds = seconds_since(start);
+
+        start = Clock::now();
+        run_manager->BeamOn(config.events);
+        result.loop_seconds = seconds_since(start);
+        result.latencies = EventTimingAction::collect();
+        return result;
+    }
+
+    // SimpleMasterRunManager driven by our own thread pool, as g4-test-ownmt
+    BenchResult run_ownmt(const BenchConfig& config) {
+        BenchResult result{};
+        auto start = Clock::now();
+        SimpleMasterRunManager* run_manager = new SimpleMasterRunManager;
+        run_manager->SetSeedingMode(SimpleMasterRunManager::SeedingMode::Counter);
+        run_manager->SetStreamingMode(config.stream);
+        auto physics_cache = setup_run_manager(run_manager, config);
+        auto init_start = Clock::now();
+        run_manager->Initialize();
+        finish_physics_cache(physics_cache.get(), config, init_start, result);
+
+        auto module = std::make_unique<Module>(run_manager);
+        module->init();
+
+        {
+            ThreadPool pool(static_cast<unsigned int>(config.threads), [module = module.get()]() {
+                module->finializeThread();
+            }, ThreadPool::Placement::parse(config.placement));
+            run_manager->WarmUp(pool);
+            result.init_seconds = seconds_since(start);
+
+            // Keep only a few batches queued per thread, the closures of all batches are never held at once
+            pool.set_capacity(4 * pool.size());
+
+            start = Clock::now();
+            int batches_num = (config.events + config.batch - 1) / config.batch;
+            CountdownLatch events_done(static_cast<size_t>(batches_num));
+            pool.submit_bulk(static_cast<size_t>(batches_num), [module = module.get(), &config](size_t batch) {
+                // Numbered from 0 like the events of the other execution models
+                int first_event = static_cast<int>(batch) * config.batch;
+                module->run_range(first_event, std::min(config.batch, config.events - first_event));
+            }, events_done);
+            events_done.wait();
+            result.loop_seconds = seconds_since(start);
+            result.latencies = EventTimingAction::collect();
+
+            pool.shutdown();
+        }
+
+        module->finialize();
+        delete run_manager;
+        return result;
+    }
+
+    // Cost of generating the primaries of an event with every generator, without simulating the event
+    std::string run_generators(const BenchConfig& config) {
+        // The particle definitions only exist once the physics list is initialized
+        auto run_manager = std::make_unique<G4RunManager>();
+        setup_run_manager(run_manager.get(), config);
+        run_manager->Initialize();
+
+        std::vector<std::pair<std::string, std::unique_ptr<G4VUserPrimaryGeneratorAction>>> generators;
+        generators.emplace_back("gps", std::make_unique<GeneratorActionG4>(config.energy));
+        generators.emplace_back("beamgun", std::unique_ptr<G4VUserPrimaryGeneratorAction>(MakeBeamGunActionG4(config.energy)));
+        generators.emplace_back("presampled", std::make_unique<PresampledGeneratorActionG4>(
+            config.energy, BenchActionInitialization::primary_seed, config.presample > 0 ? config.presample : 256));
+
+        std::stringstream json;
+        json << "{\"mode\": \"generators\", \"events\": " << config.events << ", \"energy_mev\": " << config.energy
+             << ", \"ns_per_event\": {";
+        for(size_t g = 0; g < generators.size(); ++g) {
+            auto start = Clock::now();
+            for(int i = 0; i < config.events; ++i) {
+                G4Event event(i);
+                generators[g].second->GeneratePrimaries(&event);
+            }
+            json << (g > 0 ? ", " : "") << "\"" << generators[g].first
+                 << "\": " << seconds_since(start) * 1e9 / std::max(1, config.events);
+        }
+        json << "}}";
+        return json.str();
+    }
+
+    // Nearest-rank percentile of sorted values
+    double percentile(const std::vector<double>& sorted, double fraction) {
+        if(sorted.empty()) {
+            return 0;
+        }
+        auto rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    long peak_rss_kb() {
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    std::string to_json(const BenchConfig& config, BenchResult& result) {
+        std::sort(result.latencies.begin(), result.latencies.end());
+        double mean = 0;
+        for(double latency : result.latencies) {
+            mean += latency / static_cast<double>(result.latencies.size());
+        }
+
+        std::stringstream json;
+        json << "{\"mode\": \"" << config.mode << "\", \"threads\": " << config.threads << ", \"events\": " << config.events
+             << ", \"energy_mev\": " << config.energy << ", \"batch\": " << config.batch
+             << ", \"stream\": " << (config.stream ? "true" : "false") << ", \"placement\": \"" << config.placement
+             << "\", \"presample\": " << config.presample << ", \"gun\": " << (config.gun ? "true" : "false")
+             << ", \"planes\": " << config.planes << ", \"plane_placement\": \"" << config.plane_placement
+             << "\", \"smartless\": \"" << config.smartless << "\", \"pitch_mm\": " << config.pitch << ", \"pixel_pitch_mm\": " << config.pixel_pitch << ", \"steps\": " << result.steps
+             << ", \"hits\": " << result.hits
+             << ", \"steps_per_s\": " << (result.loop_seconds > 0 ? static_cast<double>(result.steps) / result.loop_seconds : 0)
+             << ", \"world_cut_mm\": " << config.world_cut << ", \"sensor_cut_mm\": " << config.sensor_cut
+             << ", \"physics_cache\": \"" << (result.physics_cache.empty() ? "off" : result.physics_cache) << "\""
+             << ", \"policy\": {\"measure_only\": " << (config.policy.measure_only ? "true" : "false");
+        auto policy = PerformancePolicy::Results();
+        for(std::size_t rule = 0; rule < PerformancePolicy::n_rules; ++rule) {
+            json << ", \"" << PerformancePolicy::rule_name(static_cast<PerformancePolicy::Rule>(rule)) << "\": {\"tracks\": "
+                 << policy[rule].tracks << ", \"steps\": " << policy[rule].steps << ", \"seconds\": " << policy[rule].seconds << "}";
+        }
+        json << "}, \"init_s\": " << result.init_seconds << ", \"loop_s\": " << result.loop_seconds
+             << ", \"throughput_eps\": " << (result.loop_seconds > 0 ? config.events / result.loop_seconds : 0)
+             << ", \"latency_ms\": {\"mean\": " << mean * 1e3 << ", \"p50\": " << percentile(result.latencies, 0.5) * 1e3
+             << ", \"p90\": " << percentile(result.latencies, 0.9) * 1e3 << ", \"p99\": " << percentile(result.latencies, 0.99) * 1e3
+             << ", \"max\": " << (result.latencies.empty() ? 0 : result.latencies.back() * 1e3) << "}"
+             << ", \"peak_rss_mb\": " << static_cast<double>(peak_rss_kb()) / 1024. << "}";
+        return json.str();
+    }
+
+    // Run a single configuration in this process and return its measurements as JSON
+    std::string run_single(const BenchConfig& config) {
+        BenchResult result{};
+        if(config.mode == "generators") {
+            return run_generators(config);
+        } else if(config.mode == "nomt") {
+            result = run_nomt(config);
+        } else if(config.mode == "g4mt") {
+            result = run_g4mt(config);
+        } else if(config.mode == "ownmt") {
+            result = run_ownmt(config);
+        } else {
+            throw std::invalid_argument("unknown mode " + config.mode);
+        }
+
+        // The workers have been destroyed and merged their profiles by now
+        RunSummary summary = RunTally::Merge();
+        result.steps = summary.steps;
+        result.hits = summary.hits;
+        if(config.profile) {
+            SteppingProfiler::Print(std::cerr);
+        }
+        if(config.policy.enabled()) {
+            PerformancePolicy::Print(std::cerr);
+        }
+        return to_json(config, result);
+    }
+
+    // Run a single configuration in a child process, only one Geant4 run manager can exist per process
+    bool run_child(const std::vector<std::string>& args, bool verbose, std::string& json) {
+        char result_path[] = "/tmp/g4-bench-XXXXXX";
+        int result_fd = mkstemp(result_path);
+        if(result_fd < 0) {
+            return false;
+        }
+        close(result_fd);
+
+        std::vector<std::string> child_args{"g4-bench"};
+        child_args.insert(child_args.end(), args.begin(), args.end());
+        child_args.push_back("--result");
+        child_args.push_back(result_path);
+
+        pid_t pid = fork();
+        if(pid == 0) {
+            if(!verbose) {
+                // Keep the Geant4 output of the child out of the report
+                int null_fd = open("/dev/null", O_WRONLY);
+                dup2(null_fd, STDOUT_FILENO);
+            }
+            std::vector<char*> argv;
+            for(auto& arg : child_args) {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+
+        int status = 0;
+        bool success = (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        std::ifstream result_file(result_path);
+        std::getline(result_file, json);
+        unlink(result_path);
+        return success && !json.empty();
+    }
+
+    std::vector<std::string> split(const std::string& list) {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while(std::getline(stream, item, ',')) {
+            if(!item.empty()) {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+} // namespace
+
+int main(int argc, char *argv[]) {
+    // Options are given as "--name value", flags as "--name"
+    std::map<std::string, std::string> options;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg.compare(0, 2, "--") != 0) {
+            std::cerr << "Unexpected argument " << arg << std::endl;
+            return 1;
+        }
+        bool has_value = (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0);
+        options[arg.substr(2)] = (has_value ? argv[++i] : "true");
+    }
+    auto option = [&options](const std::string& name, const std::string& fallback) {
+        auto it = options.find(name);
+        return it == options.end() ? fallback : it->second;
+    };
+
+    if(options.count("help")) {
+        std::cout << "Usage: g4-bench [--modes nomt,g4mt,ownmt] [--threads 1,2,4] [--events 100] [--energies 120]\n"
+                  << "                [--batch 1] [--stream] [--placement none|compact|scatter|cpu list]\n"
+                  << "                [--profile] [--presample block size] [--gun] [--planes 0,8,64]\n"
+                  << "                [--plane-placement replica|parameterised|individual] [--smartless volume=value,...]\n"
+                  << "                [--pitch mm] [--pixel-pitch mm] [--world-cut mm] [--sensor-cut mm]\n"
+                  << "                [--kill-below MeV] [--kill-unreachable] [--roi-margin mm] [--policy-measure]\n"
+                  << "                [--physics-cache dir] [--output file] [--verbose]\n"
+                  << "Modes also include \"generators\", timing the primary generators without simulating events.\n"
+                  << "Planes > 0 replaces the single sensor by a telescope of that many planes.\n"
+                  << "Runs every combination in a separate process and reports the results as JSON.\n";
+        return 0;
+    }
+
+    // Reject malformed placements before any run is started, a child process would only report that it failed
+    try {
+        ThreadPool::Placement::parse(option("placement", "none"));
+        GeometryConfig::parse_placement(option("plane-placement", "replica"));
+        GeometryConfig::parse_smartless(option("smartless", ""));
+    } catch(const std::invalid_argument& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    // A single configuration, executed in this process
+    if(options.count("mode")) {
+        BenchConfig config{option("mode", ""), std::stoi(option("threads", "1")), std::stoi(option("events", "100")),
+                           std::stod(option("energy", "120")), std::max(1, std::stoi(option("batch", "1"))),
+                           options.count("stream") > 0, option("placement", "none"), options.count("profile") > 0,
+                           static_cast<std::size_t>(std::stoul(option("presample", "0"))), options.count("gun") > 0,
+                           std::stoi(option("planes", "0")), option("plane-placement", "replica"), option("smartless", ""),
+                           std::stod(option("pitch", "10")), std::stod(option("pixel-pitch", "0")),
+                           std::stod(option("world-cut", "0")), std::stod(option("sensor-cut", "0")), PolicyConfig(),
+                           option("physics-cache", "")};
+        config.policy.min_secondary_energy = std::stod(option("kill-below", "0"));
+        config.policy.kill_unreachable = options.count("kill-unreachable") > 0;
+        config.policy.roi_margin = std::stod(option("roi-margin", "-1"));
+        config.policy.measure_only = options.count("policy-measure") > 0;
+        std::string json = run_single(config);
+        if(options.count("result")) {
+            std::ofstream(options["result"]) << json << std::endl;
+        } else {
+            std::cout << json << std::endl;
+        }
+        return 0;
+    }
+
+    // All combinations of the given lists, each in its own process
+    std::vector<std::string> reports;
+    for(const auto& mode : split(option("modes", "nomt,g4mt,ownmt"))) {
+        for(const auto& threads : split(option("threads", "1"))) {
+            // The sequential run manager and the generator timing only ever use one thread
+            bool single_threaded = (mode == "nomt" || mode == "generators");
+            if(single_threaded && threads != split(option("threads", "1")).front()) {
+                continue;
+            }
+            for(const auto& events : split(option("events", "100"))) {
+                for(const auto& energy : split(option("energies", "120"))) {
+                    for(const auto& planes : split(option("planes", "0"))) {
+                        std::vector<std::string> args{"--mode", mode, "--threads", (single_threaded ? "1" : threads), "--events",
+                                                      events, "--energy", energy, "--batch", option("batch", "1"),
+                                                      "--placement", option("placement", "none"), "--presample",
+                                                      option("presample", "0"), "--planes", planes, "--plane-placement",
+                                                      option("plane-placement", "replica"), "--pitch", option("pitch", "10"),
+                                                      "--pixel-pitch", option("pixel-pitch", "0"), "--world-cut",
+                                                      option("world-cut", "0"), "--sensor-cut", option("sensor-cut", "0"),
+                                                      "--kill-below", option("kill-below", "0"), "--roi-margin",
+                                                      option("roi-margin", "-1")};
+                        if(options.count("smartless")) {
+                            args.push_back("--smartless");
+                            args.push_back(options["smartless"]);
+                        }
+                        if(options.count("physics-cache")) {
+                            args.push_back("--physics-cache");
+                            args.push_back(options["physics-cache"]);
+                        }
+                        if(options.count("stream")) {
+                            args.push_back("--stream");
+                        }
+                        if(options.count("profile")) {
+                            args.push_back("--profile");
+                        }
+                        if(options.count("gun")) {
+                            args.push_back("--gun");
+                        }
+                        if(options.count("kill-unreachable")) {
+                            args.push_back("--kill-unreachable");
+                        }
+                        if(options.count("policy-measure")) {
+                            args.push_back("--policy-measure");
+                        }
+
+                        std::cerr << "Running " << mode << " with " << threads << " thread(s), " << events << " event(s) at "
+                                  << energy << " MeV, " << planes << " plane(s)" << std::endl;
+                        std::string json;
+                        if(run_child(args, options.count("verbose") > 0, json)) {
+                            reports.push_back(json);
+                        } else {
+                            std::cerr << "Benchmark run failed" << std::endl;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::stringstream output;
+    output << "[\n";
+    for(size_t i = 0; i < reports.size(); ++i) {
+        output << "  " << reports[i] << (i + 1 < reports.size() ? ",\n" : "\n");
+    }
+    output << "]\n";
+
+    if(options.count("output")) {
+        std::ofstream(options["output"]) << output.str();
+    } else {
+        std::cout << output.str();
+    }
+    return reports.empty() ? 1 : 0;
+}
@@ -1,8 +1,10 @@
+#include <chrono>
 #include <string>
 #include <iostream>
 
 #include "simulation/geometry.hpp"
 #include "simulation/generator.hpp"
+#include "simulation/physicscache.hpp"
 
 #include <G4MTRunManager.hh>
 #include <G4StepLimiterPhysics.hh>
@@ -31,6 +33,9 @@ int main(int argc, char *argv[]) {
     run_manager_g4_->SetUserInitialization(physicsList);
     run_manager_g4_->InitializePhysics();
 
+    // Reuse the physics tables of a previous start if G4MT_PHYSICS_CACHE names a cache directory
+    auto physics_cache = PhysicsTableCache::FromEnvironment("FTFP_BERT_EMZ", physicsList);
+
     // Particle source
     run_manager_g4_->SetUserInitialization(new GeneratorActionInitialization());
 
@@ -45,8 +50,14 @@ int main(int argc, char *argv[]) {
     G4UImanager* ui_g4 = G4UImanager::GetUIpointer();
     ui_g4->ApplyCommand(seed_command);
 
-    // Initialize the full run manager to ensure correct state flags
+    // Initialize the full run manager to ensure correct state flags, this builds the physics tables
+    auto init_start = std::chrono::steady_clock::now();
     run_manager_g4_->Initialize();
+    if(physics_cache) {
+        // Initialize also starts the worker threads, so the startup depends on their number
+        physics_cache->Finish(std::chrono::duration<double>(std::chrono::steady_clock::now() - init_start).count(),
+                              "g4-test-g4mt with " + std::to_string(threads_num) + " thread(s)", std::cout);
+    }
 
     // Execute the event loop:
     run_manager_g4_->BeamOn(10);
@@ -1,8 +1,10 @@
+#include <chrono>
 #include <string>
 #include <iostream>
 
 #include "simulation/geometry.hpp"
 #include "simulation/generator.hpp"
+#include "simulation/physicscache.hpp"
 
 #include <G4RunManager.hh>
 #include <G4StepLimiterPhysics.hh>
@@ -25,6 +27,9 @@ int main() {
     run_manager_g4_->SetUserInitialization(physicsList);
     run_manager_g4_->InitializePhysics();
 
+    // Reuse the physics tables of a previous start if G4MT_PHYSICS_CACHE names a cache directory
+    auto physics_cache = PhysicsTableCache::FromEnvironment("FTFP_BERT_EMZ", physicsList);
+
     // Particle source
     run_manager_g4_->SetUserInitialization(new GeneratorActionInitialization());
 
@@ -40,7 +45,14 @@ int main() {
     ui_g4->ApplyCommand(seed_command);
 
     // Initialize the full run manager to ensure correct state flags
+    auto init_start = std::chrono::steady_clock::now();
     run_manager_g4_->Initialize();
+    if(physics_cache) {
+        // The sequential run manager only builds the physics tables in its first run
+        run_manager_g4_->BeamOn(0);
+        physics_cache->Finish(std::chrono::duration<double>(std::chrono::steady_clock::now() - init_start).count(), "g4-test-nomt",
+                              std::cout);
+    }
 
     // Run our own event loop:
     for(int i = 0; i < 5; i++) {
@@ -1,12 +1,20 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <thread>
 #include <vector>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <iostream>
 
 #include "simulation/geometry.hpp"
 #include "simulation/generator.hpp"
+#include "simulation/hitwriter.hpp"
+#include "simulation/physicscache.hpp"
+#include "tools/Instrumentation.hpp"
+#include "tools/OrderedSink.hpp"
+#include "tools/SubEvent.hpp"
 #include "tools/ThreadPool.hpp"
 
 #include <G4StepLimiterPhysics.hh>
@@ -30,8 +38,53 @@ int main(int argc, char *argv[]) {
     int threads_num = args.size() > 0 ? std::stoi(args[0]) : 1;
     std::cout << "Using " << threads_num << " thread(s).\n";
 
+    // How many events and how many of them are simulated within a single run?
+    int events_num = args.size() > 1 ? std::stoi(args[1]) : 5;
+    int batch_size = args.size() > 2 ? std::max(1, std::stoi(args[2])) : 1;
+    std::cout << "Running " << events_num << " event(s) in batches of " << batch_size << ".\n";
+
+    // Where do the threads run? One of "none", "compact", "scatter" or a list of CPUs
+    ThreadPool::Placement placement;
+    try {
+        placement = ThreadPool::Placement::parse(args.size() > 3 ? args[3] : "none");
+    } catch(const std::invalid_argument& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+
+    // Does every worker open a run per batch ("run") or keep a single run open ("stream")?
+    bool streaming = args.size() > 4 && args[4] == "stream";
+
+    // Where are the hits written to? Nothing is written without a file name or with "-"
+    std::string hits_file = args.size() > 5 && args[5] != "-" ? args[5] : "";
+
+    // How many finished events can wait for an earlier one before the submission is throttled?
+    int window_size = args.size() > 6 ? std::max(1, std::stoi(args[6])) : 64;
+
+    // Into how many sub-events is every event split, and how many primaries does an event have?
+    // Sub-events of an event run on different threads, batches are not used then
+    int sub_events = args.size() > 7 ? std::max(1, std::stoi(args[7])) : 1;
+    int particles = args.size() > 8 ? std::max(0, std::stoi(args[8])) : (sub_events > 1 ? 100 : 0);
+    if(sub_events > 1 && particles < sub_events) {
+        // Slices without primaries would be empty events, and the single-particle generators ignore the slicing
+        std::cerr << "Splitting an event into " << sub_events << " sub-events requires at least as many particles, got "
+                  << particles << "." << std::endl;
+        return 1;
+    }
+    if(sub_events > 1) {
+        std::cout << "Splitting every event of " << particles << " particle(s) into " << sub_events << " sub-events.\n";
+    }
+
+    // To how many threads is the pool resized halfway through the event loop? It returns to the
+    // original size after three quarters of the events, 0 keeps the size
+    int resize_threads = args.size() > 9 ? std::max(0, std::stoi(args[9])) : 0;
+
     SimpleMasterRunManager* run_manager_ = new SimpleMasterRunManager;
 
+    // Derive the seeds from the event number so results do not depend on scheduling
+    run_manager_->SetSeedingMode(SimpleMasterRunManager::SeedingMode::Counter);
+    run_manager_->SetStreamingMode(streaming);
+
     // Initialize the geometry:
     auto geometry_construction = new GeometryConstructionG4();
     run_manager_->SetUserInitialization(geometry_construction);
@@ -44,8 +97,16 @@ int main(int argc, char *argv[]) {
     run_manager_->SetUserInitialization(physicsList);
     run_manager_->InitializePhysics();
 
-    // Particle source
-    run_manager_->SetUserInitialization(new GeneratorActionInitialization());
+    // Reuse the physics tables of a previous start if G4MT_PHYSICS_CACHE names a cache directory
+    auto physics_cache = PhysicsTableCache::FromEnvironment("FTFP_BERT_EMZ", physicsList);
+
+    // Particle source, events with many particles derive all of them from the event number
+    auto action_initialization = new GeneratorActionInitialization();
+    action_initialization->SetStepCounting(true);
+    if(particles > 0) {
+        action_initialization->SetMultiplicity(static_cast<size_t>(particles), 1);
+    }
+    run_manager_->SetUserInitialization(action_initialization);
     // run_manager_->SetUserAction(new GeneratorActionG4());
 
     // Set the seeds before calling initialize
@@ -62,38 +123,155 @@ int main(int argc, char *argv[]) {
 
     // Initialize the full run manager to ensure correct state flags
     // This call will initialize the manager's event loop and as such enable later calls
-    // for BeamOn on multiple threads
+    // for BeamOn on multiple threads. The master builds the physics tables here.
+    auto init_start = std::chrono::steady_clock::now();
     run_manager_->Initialize();
+    if(physics_cache) {
+        physics_cache->Finish(std::chrono::duration<double>(std::chrono::steady_clock::now() - init_start).count(), "g4-test-ownmt",
+                              std::cout);
+    }
+
+    // Workers only copy the hits of every event into their own ring, a separate thread writes them out
+    // The hits of the sub-events of an event are merged into a single event first
+    std::unique_ptr<HitWriter> hit_writer;
+    std::unique_ptr<SubEventMerger<HitBuffer>> hit_merger;
+    if(!hits_file.empty()) {
+        hit_writer = std::make_unique<HitWriter>(hits_file);
+        hit_merger = std::make_unique<SubEventMerger<HitBuffer>>([writer = hit_writer.get()](std::int64_t event_id,
+                                                                                              std::vector<HitBuffer>&& parts) {
+            HitBuffer merged;
+            G4int track_offset = 0;
+            for(const auto& part : parts) {
+                merged.append(part, track_offset);
+                track_offset += part.max_track_id();
+            }
+            writer->publish(static_cast<G4int>(event_id), merged);
+        });
+        SensitiveDetectorActionG4::SetEventCallback([writer = hit_writer.get(), merger = hit_merger.get()](G4int event_id,
+                                                                                                          const HitBuffer& hits) {
+            const SubEventSlice& slice = SubEventSlice::current();
+            if(slice.active) {
+                merger->add(event_id, slice.index, slice.count, hits);
+            } else {
+                writer->publish(event_id, hits);
+            }
+        });
+    }
 
     auto module = std::make_unique<Module>(run_manager_);
     module->init();
 
-    std::vector<std::future<bool>> module_futures;
-
     // Start new thread pool and create module object:
+    // Threads are pinned before they create their worker, so all per-thread Geant4 state
+    // is allocated on the NUMA node the thread runs on
     ThreadPool pool(threads_num, [module = module.get()]() {
         // cleanup all thread local stuff
         module->finializeThread();
+    }, placement, static_cast<size_t>(std::max(threads_num, resize_threads)));
+    std::cout << pool.placement_report();
+
+    // Build the workers of all threads at once before the first event
+    run_manager_->WarmUp(pool);
+    for(const auto& init_time : run_manager_->GetWorkerInitTimes()) {
+        std::cout << "Worker " << init_time.thread_id << " initialized in " << init_time.seconds << " s.\n";
+    }
+
+    // Report throughput and utilization every second if the timers are compiled in,
+    // the summary is printed when the reporter is destroyed after the pool has stopped
+    std::unique_ptr<instrumentation::PeriodicReporter> reporter;
+    if(instrumentation::enabled()) {
+        reporter = std::make_unique<instrumentation::PeriodicReporter>(
+            std::cout, std::chrono::milliseconds(1000), [&pool]() { return pool.queue_depth(); });
+    }
+
+    // The event loop, each task simulates a batch of consecutive events. Events finish out of
+    // order, the sink hands their results downstream in event order. Batches are only submitted
+    // while their events fit into the reorder window, so a slow event throttles the submission
+    // instead of letting the buffered results grow:
+    int aborted_events = 0;
+    OrderedSink<bool> ordered_events(1, static_cast<size_t>(std::max(window_size, batch_size)),
+                                     [&aborted_events](std::int64_t, bool&& success) {
+        if(!success) {
+            aborted_events++;
+        }
+    });
+
+    // An event split into sub-events is complete once all of its sub-events are
+    SubEventMerger<bool> event_parts([&ordered_events](std::int64_t event, std::vector<bool>&& parts) {
+        ordered_events.push(event, std::all_of(parts.begin(), parts.end(), [](bool success) { return success; }));
     });
 
-    // The event loop:
-    for (int i = 0; i < 5; i++) {
-        // Define module execution:
-        auto execute_module = [module = module.get(), event_num = i + 1]() {
-            return module->run(event_num);
-        };
+    // Threads are retired and added while events are in flight, the retired threads finish the
+    // tasks queued to them and terminate their worker
+    int resize_step = 0;
+    auto resize_pool = [&](int event) {
+        if(resize_threads == 0 || resize_step == 2 || event <= events_num * (resize_step + 2) / 4) {
+            return;
+        }
+        pool.resize(static_cast<size_t>(resize_step == 0 ? resize_threads : threads_num));
+        std::cout << "Resized the pool to " << pool.size() << " thread(s) before event " << event << ".\n";
+        ++resize_step;
+    };
 
-        module_futures.push_back(pool.submit(execute_module));
+    if(sub_events > 1) {
+        for(int event = 1; event <= events_num; ++event) {
+            resize_pool(event);
+            ordered_events.acquire(event);
+            for(int slice = 0; slice < sub_events; ++slice) {
+                pool.submit_detached([module = module.get(), &event_parts, event, slice, sub_events]() {
+                    bool success = module->run_sub_event(event, slice, sub_events);
+                    event_parts.add(event, static_cast<std::uint32_t>(slice), static_cast<std::uint32_t>(sub_events), success);
+                });
+            }
+        }
+    } else {
+        for(int first_event = 1; first_event <= events_num; first_event += batch_size) {
+            resize_pool(first_event);
+            int count = std::min(batch_size, events_num - first_event + 1);
+            ordered_events.acquire(first_event + count - 1);
+            pool.submit_detached([module = module.get(), &ordered_events, first_event, count]() {
+                auto results = module->run_range(first_event, count);
+                for(int i = 0; i < count; ++i) {
+                    ordered_events.push(first_event + i, results[static_cast<size_t>(i)]);
+                }
+            });
+        }
+    }
+
+    // Wait for all events:
+    ordered_events.wait_until(events_num + 1);
+    if(aborted_events > 0) {
+        std::cerr << aborted_events << " event(s) were aborted." << std::endl;
     }
+    auto reorder = ordered_events.statistics();
+    std::cout << "Reorder buffer held at most " << reorder.max_occupancy << " event(s), " << reorder.mean_occupancy
+              << " on average, submission was throttled " << reorder.throttled << " time(s).\n";
 
-    // Ask for futures:
-    for(auto& module_future : module_futures) {
-        module_future.get();
+    // Per-worker statistics from the master registry, then the master terminates all workers
+    for(const auto& worker : run_manager_->GetWorkers()) {
+        std::cout << "Worker " << worker.thread_id << " simulated " << worker.events_processed << " event(s) in "
+                  << worker.busy_seconds << " s.\n";
+    }
+    std::size_t remaining = run_manager_->TerminateAllWorkers(pool);
+    if(remaining > 0) {
+        std::cerr << remaining << " worker(s) outside the pool are still alive." << std::endl;
     }
 
     pool.shutdown();
+    reporter.reset();
+
+    // All workers are done, write the remaining hits
+    if(hit_writer) {
+        SensitiveDetectorActionG4::SetEventCallback(nullptr);
+        hit_writer->close();
+        hit_writer->print_statistics(std::cout);
+        if(!hit_writer->error().empty()) {
+            std::cerr << "The hits file is incomplete: " << hit_writer->error() << std::endl;
+        }
+    }
 
     module->finialize();
+    run_manager_->GetRunSummary().print(std::cout);
 
     delete run_manager_;
 
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include <G4Electron.hh>
+#include <G4Event.hh>
+#include <G4MuonMinus.hh>
+#include <G4PionPlus.hh>
+#include <G4PrimaryParticle.hh>
+#include <G4PrimaryVertex.hh>
+#include <G4Proton.hh>
+#include <G4ThreeVector.hh>
+#include <G4VUserPrimaryGeneratorAction.hh>
+#include <Randomize.hh>
+
+/**
+ * @brief Building blocks of BeamGunG4, every one of them is selected at compile time
+ *
+ * A particle type provides the static Definition() of the particle. A position distribution provides
+ * sample(engine) returning the vertex position, an energy distribution provides sample(engine) returning the kinetic
+ * energy. All of them are plain classes without virtual functions, so the compiler can inline the whole event path.
+ */
+namespace beam {
+    struct PionPlus {
+        static G4ParticleDefinition* Definition() { return G4PionPlus::Definition(); }
+    };
+    struct Proton {
+        static G4ParticleDefinition* Definition() { return G4Proton::Definition(); }
+    };
+    struct Electron {
+        static G4ParticleDefinition* Definition() { return G4Electron::Definition(); }
+    };
+    struct MuonMinus {
+        static G4ParticleDefinition* Definition() { return G4MuonMinus::Definition(); }
+    };
+
+    /**
+     * @brief Standard normal number from two uniform numbers of the engine (Box-Muller)
+     */
+    inline double gauss(CLHEP::HepRandomEngine* engine) {
+        constexpr double two_pi = 6.283185307179586476925286766559;
+        double radius = std::sqrt(-2. * std::log(engine->flat()));
+        return radius * std::cos(two_pi * engine->flat());
+    }
+
+    /**
+     * @brief All particles start at the same point
+     */
+    class PencilBeam {
+    public:
+        explicit PencilBeam(const G4ThreeVector& origin = G4ThreeVector()) : origin_(origin) {}
+        G4ThreeVector sample(CLHEP::HepRandomEngine*) const { return origin_; }
+
+    private:
+        G4ThreeVector origin_;
+    };
+
+    /**
+     * @brief Gaussian transverse profile around the origin, like the "Beam" distribution of the particle source
+     */
+    class GaussianBeam {
+    public:
+        explicit GaussianBeam(double sigma, const G4ThreeVector& origin = G4ThreeVector()) : sigma_(sigma), origin_(origin) {}
+        G4ThreeVector sample(CLHEP::HepRandomEngine* engine) const {
+            double x = sigma_ * gauss(engine);
+            double y = sigma_ * gauss(engine);
+            return origin_ + G4ThreeVector(x, y, 0);
+        }
+
+    private:
+        double sigma_;
+        G4ThreeVector origin_;
+    };
+
+    /**
+     * @brief All particles have the same energy, draws no random numbers
+     */
+    class MonoEnergetic {
+    public:
+        explicit MonoEnergetic(double energy) : energy_(energy) {}
+        double sample(CLHEP::HepRandomEngine*) const { return energy_; }
+
+    private:
+        double energy_;
+    };
+
+    /**
+     * @brief Gaussian energy spread around the mean energy
+     */
+    class GaussianEnergy {
+    public:
+        GaussianEnergy(double mean, double sigma) : mean_(mean), sigma_(sigma) {}
+        double sample(CLHEP::HepRandomEngine* engine) const { return mean_ + sigma_ * gauss(engine); }
+
+    private:
+        double mean_;
+        double sigma_;
+    };
+} // namespace beam
+
+/**
+ * @brief Lightweight particle gun whose particle, distributions and multiplicity are fixed at compile time
+ *
+ * Generates a single vertex per event with Multiplicity particles along z, each with its own energy, like the particle
+ * source does. The per-event path consists of direct calls into the distributions and the random engine only, there
+ * is no lookup of string-keyed settings and no virtual dispatch apart from the engine itself.
+ */
+template <typename Particle, typename Position, typename Energy, std::size_t Multiplicity = 1>
+class BeamGunG4 final : public G4VUserPrimaryGeneratorAction {
+    static_assert(Multiplicity > 0, "the gun has to shoot at least one particle");
+
+public:
+    /**
+     * @brief Constructs the gun
+     * @param position Distribution of the vertex position
+     * @param energy Distribution of the kinetic energy of every particle
+     */
+    BeamGunG4(const Position& position, const Energy& energy)
+        : position_(position), energy_(energy), definition_(Particle::Definition()) {}
+
+    /**
+     * @brief Generate the vertex and the particles of the event
+     */
+    void GeneratePrimaries(G4Event* event) override {
+        CLHEP::HepRandomEngine* engine = G4Random::getTheEngine();
+
+        auto vertex = new G4PrimaryVertex(position_.sample(engine), 0.);
+        for(std::size_t i = 0; i < Multiplicity; ++i) {
+            auto particle = new G4PrimaryParticle(definition_);
+            particle->SetMomentumDirection(G4ThreeVector(0, 0, 1));
+            particle->SetKineticEnergy(energy_.sample(engine));
+            vertex->SetPrimary(particle);
+        }
+        event->AddPrimaryVertex(vertex);
+    }
+
+private:
+    Position position_;
+    Energy energy_;
+    G4ParticleDefinition* definition_;
+};
+
+/**
+ * @brief Drop-in replacement for GeneratorActionG4: a single pi+ with a 1 mm Gaussian beam profile
+ *
+ * The particle source configured by GeneratorActionG4 uses a Gaussian energy distribution without width, which is the
+ * mono-energetic case, so no random numbers are spent on the energy.
+ */
+using BeamGunActionG4 = BeamGunG4<beam::PionPlus, beam::GaussianBeam, beam::MonoEnergetic>;
+
+/**
+ * @brief Create the drop-in beam gun for the given beam energy
+ */
+inline BeamGunActionG4* MakeBeamGunActionG4(double energy = 120.) {
+    return new BeamGunActionG4(beam::GaussianBeam(1.), beam::MonoEnergetic(energy));
+}
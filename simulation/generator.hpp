@@ -1,9 +1,21 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
 #include <G4Event.hh>
 #include <G4GeneralParticleSource.hh>
 #include <G4VUserPrimaryGeneratorAction.hh>
 #include <G4VUserActionInitialization.hh>
 #include <G4ParticleTable.hh>
 
+#include "beamgun.hpp"
+#include "multiparticle.hpp"
+#include "policy.hpp"
+#include "presampled.hpp"
+#include "profiler.hpp"
+#include "steppingchain.hpp"
+#include "tally.hpp"
+
 /**
  * @brief Generates the particles in every event
  */
@@ -11,8 +23,9 @@ class GeneratorActionG4 : public G4VUserPrimaryGeneratorAction {
 public:
     /**
      * @brief Constructs the generator action
+     * @param energy Mean energy of the beam particles
      */
-    explicit GeneratorActionG4(): particle_source_(std::make_unique<G4GeneralParticleSource>()) {
+    explicit GeneratorActionG4(double energy = 120.): particle_source_(std::make_unique<G4GeneralParticleSource>()) {
         auto source = particle_source_->GetCurrentSource();
         source->GetPosDist()->SetPosDisType("Beam");
         source->GetPosDist()->SetBeamSigmaInR(1.);
@@ -22,7 +35,7 @@ public:
         source->SetNumberOfParticles(1);
 
         source->GetEneDist()->SetEnergyDisType("Gauss");
-        source->GetEneDist()->SetMonoEnergy(120);
+        source->GetEneDist()->SetMonoEnergy(energy);
     };
 
     /**
@@ -41,13 +54,123 @@ private:
  */
 class GeneratorActionInitialization : public G4VUserActionInitialization {
 public:
-    explicit GeneratorActionInitialization() = default;
+    /**
+     * @brief Constructs the initializer
+     * @param energy Mean energy of the beam particles
+     */
+    explicit GeneratorActionInitialization(double energy = 120.) : energy_(energy) {}
+
+    /**
+     * @brief Enable the stepping profiler on every worker built afterwards
+     * @param enable True to profile the steps, see SteppingProfiler::Print for the results
+     */
+    void SetSteppingProfiler(bool enable) { stepping_profiler_ = enable; }
+
+    /**
+     * @brief Count the steps of every worker built afterwards in its RunTally slot
+     * @param enable True to count the steps, the events and hits are always tallied
+     */
+    void SetStepCounting(bool enable) { step_counting_ = enable; }
+
+    /**
+     * @brief Generate the primaries with the compile-time configured BeamGunActionG4 instead of the particle source
+     * @param enable True to use the beam gun
+     */
+    void SetBeamGun(bool enable) { beam_gun_ = enable; }
+
+    /**
+     * @brief Generate the primaries from kinematics pre-sampled in blocks instead of the particle source
+     * @param block_size Number of events sampled at once, zero uses the particle source
+     * @param master_seed Seed the primaries are derived from, see PresampledGeneratorActionG4
+     *
+     * Must be called before the workers are built.
+     */
+    void SetPresampling(std::size_t block_size, std::uint64_t master_seed) {
+        presample_block_ = block_size;
+        primary_seed_ = master_seed;
+    }
+
+    /**
+     * @brief Number the pre-sampled events in the order every worker generates them instead of by their event ID
+     * @param enable True for run managers that restart the event ID in every run, see PresampledGeneratorActionG4::CountEvents
+     */
+    void SetPresampledEventCounting(bool enable) { count_presampled_events_ = enable; }
+
+    /**
+     * @brief Generate events with many beam particles that can be split into sub-events
+     * @param multiplicity Number of particles per event, zero uses the single-particle generators
+     * @param master_seed Seed the primaries are derived from, see MultiParticleGeneratorActionG4
+     *
+     * Must be called before the workers are built.
+     */
+    void SetMultiplicity(std::size_t multiplicity, std::uint64_t master_seed) {
+        multiplicity_ = multiplicity;
+        primary_seed_ = master_seed;
+    }
+
+    /**
+     * @brief Apply the performance policy on every worker built afterwards
+     * @param config Rules of the policy, see PerformancePolicy::Print for what they killed
+     */
+    void SetPerformancePolicy(const PolicyConfig& config) { policy_ = config; }
 
     /**
      * @brief Build the user action to be executed by the worker
      */
     void Build() const override {
-        SetUserAction(new GeneratorActionG4());
+        if(multiplicity_ > 0) {
+            SetUserAction(new MultiParticleGeneratorActionG4(energy_, primary_seed_, multiplicity_));
+        } else if(presample_block_ > 0) {
+            auto generator = new PresampledGeneratorActionG4(energy_, primary_seed_, presample_block_);
+            if(count_presampled_events_) {
+                generator->CountEvents(0);
+            }
+            SetUserAction(generator);
+        } else if(beam_gun_) {
+            SetUserAction(MakeBeamGunActionG4(energy_));
+        } else {
+            SetUserAction(new GeneratorActionG4(energy_));
+        }
+
+        // A worker only takes a single stepping action, all of them run through the chain
+        auto chain = new SteppingActionChain();
+        BuildSteppingActions(*chain);
+        if(policy_.enabled()) {
+            auto policy = new PerformancePolicy(policy_);
+            chain->Add(policy);
+            SetUserAction(new PerformancePolicyStackingAction(policy));
+        }
+        if(chain->Empty()) {
+            delete chain;
+        } else {
+            SetUserAction(chain);
+        }
     };
 
+protected:
+    /**
+     * @brief Add the stepping actions of the worker, derived initializers can append their own after these
+     * @param chain Chain of stepping actions run on every step, the performance policy is appended last
+     */
+    virtual void BuildSteppingActions(SteppingActionChain& chain) const {
+        if(stepping_profiler_) {
+            auto profiler = new SteppingProfiler();
+            chain.Add(profiler);
+            SetUserAction(new SteppingProfilerTrackingAction(profiler));
+        }
+        if(step_counting_) {
+            chain.Add(new RunTallySteppingAction());
+        }
+    }
+
+private:
+    double energy_;
+    bool stepping_profiler_{false};
+    bool step_counting_{false};
+    bool beam_gun_{false};
+    std::size_t presample_block_{0};
+    bool count_presampled_events_{false};
+    std::size_t multiplicity_{0};
+    std::uint64_t primary_seed_{0};
+    PolicyConfig policy_;
 };
@@ -1,13 +1,114 @@
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "sensitive.hpp"
 
 #include <G4VUserDetectorConstruction.hh>
 #include <G4PVPlacement.hh>
+#include <G4PVParameterised.hh>
+#include <G4PVReplica.hh>
+#include <G4VPVParameterisation.hh>
 #include <G4LogicalVolume.hh>
 #include <G4Box.hh>
 #include <G4NistManager.hh>
+#include <G4ProductionCuts.hh>
+#include <G4Region.hh>
+
+/**
+ * @brief Layout of the detector built by GeometryConstructionG4
+ */
+struct GeometryConfig {
+    /**
+     * @brief How the planes of a telescope are placed in their mother volume
+     */
+    enum class Placement {
+        Replica,       ///< A single replica of plane slots along z, each slot holding a sensor
+        Parameterised, ///< A single parameterised volume positioning the sensors along z
+        Individual     ///< A separate placement per sensor
+    };
+
+    /**
+     * @brief Parse a placement from "replica", "parameterised" or "individual"
+     */
+    static Placement parse_placement(const std::string& name) {
+        if(name == "replica") {
+            return Placement::Replica;
+        } else if(name == "parameterised") {
+            return Placement::Parameterised;
+        } else if(name == "individual") {
+            return Placement::Individual;
+        }
+        throw std::invalid_argument("unknown plane placement " + name);
+    }
+
+    /**
+     * @brief Parse smartless values from a list such as "telescope_log=4,plane_slot_log=1"
+     */
+    static std::map<std::string, double> parse_smartless(const std::string& list) {
+        std::map<std::string, double> smartless;
+        std::size_t begin = 0;
+        while(begin < list.size()) {
+            std::size_t end = std::min(list.find(',', begin), list.size());
+            std::string item = list.substr(begin, end - begin);
+            begin = end + 1;
+            if(item.empty()) {
+                continue;
+            }
+
+            std::size_t equals = item.find('=');
+            std::size_t parsed = 0;
+            double value = 0;
+            try {
+                value = std::stod(item.substr(equals == std::string::npos ? item.size() : equals + 1), &parsed);
+            } catch(const std::exception&) {
+                parsed = 0;
+            }
+            if(equals == 0 || equals == std::string::npos || parsed == 0 || equals + 1 + parsed != item.size() || !(value > 0)) {
+                throw std::invalid_argument("invalid smartless " + item + ", expected volume=value with a positive value");
+            }
+            smartless[item.substr(0, equals)] = value;
+        }
+        return smartless;
+    }
+
+    // Number of telescope planes, zero builds the single sensor inside its wrapper
+    int planes{0};
+    // Distance between the centres of neighbouring planes, at least the sensor thickness
+    double pitch{10.};
+    Placement placement{Placement::Replica};
+    // Smartless value per logical volume name, volumes not listed keep the Geant4 default
+    std::map<std::string, double> smartless;
+    // Size of the square pixels the sensor deposits are digitized into, zero stores every step as a hit
+    double pixel_pitch{0.};
+    // Production cut in the sensors, zero uses the cut of the world
+    double sensor_cut{0.};
+};
+
+/**
+ * @brief Places the telescope planes along z at a fixed pitch
+ */
+class PlaneParameterisation : public G4VPVParameterisation {
+public:
+    /**
+     * @brief Constructs the parameterisation
+     * @param planes Number of planes, centred around the origin of the mother volume
+     * @param pitch Distance between the centres of neighbouring planes
+     */
+    PlaneParameterisation(int planes, double pitch) : first_z_(-0.5 * (planes - 1) * pitch), pitch_(pitch) {}
+
+    void ComputeTransformation(const G4int copy, G4VPhysicalVolume* plane) const override {
+        plane->SetTranslation(G4ThreeVector(0, 0, first_z_ + copy * pitch_));
+    }
+
+private:
+    double first_z_;
+    double pitch_;
+};
 
 /**
 * @brief Constructs the Geant4 geometry during Geant4 initialization
@@ -19,11 +120,34 @@ public:
     */
     GeometryConstructionG4() = default;
 
+    /**
+     * @brief Constructs geometry construction module with the given layout
+     * @param config Layout of the detector
+     */
+    explicit GeometryConstructionG4(GeometryConfig config) : config_(std::move(config)) {}
+
+    /**
+     * @brief Return the lower and upper corner of the box containing all sensors of the given layout
+     */
+    static std::pair<G4ThreeVector, G4ThreeVector> SensorBounds(const GeometryConfig& config) {
+        if(config.planes <= 0) {
+            return {G4ThreeVector(-sensor_half_x, -sensor_half_y, -sensor_half_z), G4ThreeVector(sensor_half_x, sensor_half_y, sensor_half_z)};
+        }
+        // Plane i is centred at (i + 1) * pitch, see ConstructTelescope
+        double pitch = std::max(config.pitch, 2 * sensor_half_z);
+        return {G4ThreeVector(-sensor_half_x, -sensor_half_y, pitch - sensor_half_z),
+                G4ThreeVector(sensor_half_x, sensor_half_y, config.planes * pitch + sensor_half_z)};
+    }
+
     /**
     * @brief Constructs the world geometry with all detectors
     * @return Physical volume representing the world
     */
     G4VPhysicalVolume* Construct() override {
+        if(config_.planes > 0) {
+            return ConstructTelescope();
+        }
+
         // Get Work material:
         auto world_material = G4NistManager::Instance()->FindOrBuildMaterial("G4_AIR");
         auto silicon  = G4NistManager::Instance()->FindOrBuildMaterial("G4_Si");
@@ -41,11 +165,13 @@ public:
         solids_.push_back(wrapper_box);
 
         // Create the sensor box and logical volume and place it
-        auto sensor_box = new G4Box("sensor_detector", 1, 1, 0.5);
+        auto sensor_box = new G4Box("sensor_detector", sensor_half_x, sensor_half_y, sensor_half_z);
         sensor_log_ = new G4LogicalVolume(sensor_box, silicon, "sensor_detector_log");
         new G4PVPlacement(nullptr, G4ThreeVector(0,0,0), sensor_log_, "sensor_detector_phys", wrapper_log, false, 0, true);
         solids_.push_back(sensor_box);
 
+        ApplySmartless({world_log_.get(), wrapper_log, sensor_log_});
+        ConstructSensorRegion();
         return world_phys_.get();
     };
 
@@ -53,11 +179,95 @@ public:
      * @brief Set up the sensitive device, add the appropriate action and (potentially) ask the field manager to process fields
      */
     void ConstructSDandField() override {
-        auto sensitive_detector_action = new SensitiveDetectorActionG4();
+        // Sensors inside replicated slots share a single placement, the plane is the copy number of the slot
+        G4int plane_depth = (config_.planes > 0 && config_.placement == GeometryConfig::Placement::Replica ? 1 : 0);
+        auto sensitive_detector_action = new SensitiveDetectorActionG4(plane_depth);
+        sensitive_detector_action->SetPixelGrid(sensor_half_x, sensor_half_y, config_.pixel_pitch);
         SetSensitiveDetector(sensor_log_, sensitive_detector_action);
     };
 
 private:
+    /**
+     * @brief Constructs a telescope of sensor planes along z, downstream of the beam origin
+     *
+     * The planes live in a single mother volume and are placed by a replica or a parameterisation, so the navigator
+     * only sees one daughter volume that it voxelizes along z instead of one placement per plane.
+     */
+    G4VPhysicalVolume* ConstructTelescope() {
+        auto world_material = G4NistManager::Instance()->FindOrBuildMaterial("G4_AIR");
+        auto silicon = G4NistManager::Instance()->FindOrBuildMaterial("G4_Si");
+
+        int planes = config_.planes;
+        double pitch = std::max(config_.pitch, 2 * sensor_half_z);
+        double half_length = 0.5 * planes * pitch;
+
+        auto world_box = new G4Box("World", 50, 50, std::max(50., 2 * half_length + pitch + 10));
+        world_log_ = std::make_unique<G4LogicalVolume>(world_box, world_material, "World", nullptr, nullptr, nullptr);
+        world_phys_ = std::make_unique<G4PVPlacement>(nullptr, G4ThreeVector(0., 0., 0.), world_log_.get(), "World", nullptr, false, 0);
+
+        // The first plane sits one pitch downstream of the beam origin
+        auto telescope_box = new G4Box("telescope", sensor_half_x, sensor_half_y, half_length);
+        auto telescope_log = new G4LogicalVolume(telescope_box, world_material, "telescope_log");
+        new G4PVPlacement(nullptr, G4ThreeVector(0, 0, half_length + 0.5 * pitch), telescope_log, "telescope_phys", world_log_.get(), false, 0, true);
+        solids_.push_back(telescope_box);
+
+        auto sensor_box = new G4Box("sensor_detector", sensor_half_x, sensor_half_y, sensor_half_z);
+        sensor_log_ = new G4LogicalVolume(sensor_box, silicon, "sensor_detector_log");
+        solids_.push_back(sensor_box);
+
+        std::vector<G4LogicalVolume*> volumes{world_log_.get(), telescope_log, sensor_log_};
+        if(config_.placement == GeometryConfig::Placement::Replica) {
+            // The replica has to fill its mother completely, every slot of one pitch holds one sensor
+            auto slot_box = new G4Box("plane_slot", sensor_half_x, sensor_half_y, 0.5 * pitch);
+            auto slot_log = new G4LogicalVolume(slot_box, world_material, "plane_slot_log");
+            new G4PVReplica("plane_slot_phys", slot_log, telescope_log, kZAxis, planes, pitch);
+            new G4PVPlacement(nullptr, G4ThreeVector(0, 0, 0), sensor_log_, "sensor_detector_phys", slot_log, false, 0);
+            solids_.push_back(slot_box);
+            volumes.push_back(slot_log);
+        } else if(config_.placement == GeometryConfig::Placement::Parameterised) {
+            parameterisation_ = std::make_unique<PlaneParameterisation>(planes, pitch);
+            new G4PVParameterised("sensor_detector_phys", sensor_log_, telescope_log, kZAxis, planes, parameterisation_.get());
+        } else {
+            for(int plane = 0; plane < planes; ++plane) {
+                double z = -half_length + (plane + 0.5) * pitch;
+                new G4PVPlacement(nullptr, G4ThreeVector(0, 0, z), sensor_log_, "sensor_detector_phys", telescope_log, false, plane);
+            }
+        }
+
+        ApplySmartless(volumes);
+        ConstructSensorRegion();
+        return world_phys_.get();
+    }
+
+    // Give the sensors their own production cut, the region is owned by the region store
+    void ConstructSensorRegion() {
+        if(config_.sensor_cut <= 0) {
+            return;
+        }
+        auto cuts = new G4ProductionCuts();
+        cuts->SetProductionCut(config_.sensor_cut);
+        auto region = new G4Region("sensor_region");
+        region->AddRootLogicalVolume(sensor_log_);
+        region->SetProductionCuts(cuts);
+    }
+
+    // Apply the configured voxelization to the given volumes
+    void ApplySmartless(const std::vector<G4LogicalVolume*>& volumes) {
+        for(auto volume : volumes) {
+            auto smartless = config_.smartless.find(volume->GetName());
+            if(smartless != config_.smartless.end()) {
+                volume->SetSmartless(smartless->second);
+            }
+        }
+    }
+
+    // Half lengths of the silicon sensor
+    static constexpr double sensor_half_x = 1;
+    static constexpr double sensor_half_y = 1;
+    static constexpr double sensor_half_z = 0.5;
+
+    GeometryConfig config_;
+    std::unique_ptr<PlaneParameterisation> parameterisation_;
     std::vector<G4VSolid*> solids_;
     G4LogicalVolume * sensor_log_;
     std::unique_ptr<G4VPhysicalVolume> world_phys_;
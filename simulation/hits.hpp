@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include <G4ThreeVector.hh>
+#include <G4Types.hh>
+
+class G4VPhysicalVolume;
+
+/**
+ * @brief Structure-of-arrays store for the hits of a single event
+ *
+ * Every column is a separate contiguous array so consumers can stream over a single quantity. Clearing the buffer only
+ * resets the size, the columns keep their capacity and act as a reusable arena: once the buffer has grown to the size
+ * of a typical event no further allocations happen on the stepping path.
+ */
+class HitBuffer {
+public:
+    /**
+     * @brief Constructs an empty buffer with room for the given number of hits
+     * @param capacity Number of hits to reserve up front
+     */
+    explicit HitBuffer(std::size_t capacity = 0) { reserve(capacity); }
+
+    /**
+     * @brief Reserve room for at least the given number of hits in every column
+     * @param capacity Number of hits to reserve
+     */
+    void reserve(std::size_t capacity) {
+        edep_.reserve(capacity);
+        x_.reserve(capacity);
+        y_.reserve(capacity);
+        z_.reserve(capacity);
+        time_.reserve(capacity);
+        track_id_.reserve(capacity);
+        volume_.reserve(capacity);
+        plane_.reserve(capacity);
+    }
+
+    /**
+     * @brief Drop all stored hits while keeping the allocated memory
+     */
+    void clear() {
+        edep_.clear();
+        x_.clear();
+        y_.clear();
+        z_.clear();
+        time_.clear();
+        track_id_.clear();
+        volume_.clear();
+        plane_.clear();
+    }
+
+    /**
+     * @brief Append a single hit
+     * @param edep Deposited energy
+     * @param position Position of the deposit
+     * @param time Global time of the deposit
+     * @param track_id Identifier of the track causing the deposit
+     * @param volume Physical volume the deposit happened in
+     * @param plane Index of the sensor plane the deposit happened in
+     */
+    void push_back(double edep, const G4ThreeVector& position, double time, G4int track_id, const G4VPhysicalVolume* volume,
+                   G4int plane = 0) {
+        edep_.push_back(edep);
+        x_.push_back(position.x());
+        y_.push_back(position.y());
+        z_.push_back(position.z());
+        time_.push_back(time);
+        track_id_.push_back(track_id);
+        volume_.push_back(volume);
+        plane_.push_back(plane);
+    }
+
+    /**
+     * @brief Append all hits of another buffer
+     * @param other Buffer to copy the hits from
+     * @param track_offset Offset added to the track ids of the appended hits
+     *
+     * Used to merge the sub-events of an event, whose track ids all start from one.
+     */
+    void append(const HitBuffer& other, G4int track_offset = 0) {
+        edep_.insert(edep_.end(), other.edep_.begin(), other.edep_.end());
+        x_.insert(x_.end(), other.x_.begin(), other.x_.end());
+        y_.insert(y_.end(), other.y_.begin(), other.y_.end());
+        z_.insert(z_.end(), other.z_.begin(), other.z_.end());
+        time_.insert(time_.end(), other.time_.begin(), other.time_.end());
+        for(G4int track_id : other.track_id_) {
+            track_id_.push_back(track_id + track_offset);
+        }
+        volume_.insert(volume_.end(), other.volume_.begin(), other.volume_.end());
+        plane_.insert(plane_.end(), other.plane_.begin(), other.plane_.end());
+    }
+
+    /**
+     * @brief Return the largest track id of all hits, zero without hits
+     */
+    G4int max_track_id() const { return track_id_.empty() ? 0 : *std::max_element(track_id_.begin(), track_id_.end()); }
+
+    std::size_t size() const { return edep_.size(); }
+    bool empty() const { return edep_.empty(); }
+
+    const std::vector<double>& edep() const { return edep_; }
+    const std::vector<double>& x() const { return x_; }
+    const std::vector<double>& y() const { return y_; }
+    const std::vector<double>& z() const { return z_; }
+    const std::vector<double>& time() const { return time_; }
+    const std::vector<G4int>& track_id() const { return track_id_; }
+    const std::vector<const G4VPhysicalVolume*>& volume() const { return volume_; }
+    const std::vector<G4int>& plane() const { return plane_; }
+
+private:
+    std::vector<double> edep_;
+    std::vector<double> x_;
+    std::vector<double> y_;
+    std::vector<double> z_;
+    std::vector<double> time_;
+    std::vector<G4int> track_id_;
+    std::vector<const G4VPhysicalVolume*> volume_;
+    std::vector<G4int> plane_;
+};
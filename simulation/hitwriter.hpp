@@ -0,0 +1,287 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hits.hpp"
+#include "../tools/SpscRing.hpp"
+
+/**
+ * @brief Writes the hits of all events to a binary file from a dedicated thread
+ *
+ * Every worker publishing hits gets its own single-producer/single-consumer ring of event records, so publishing only
+ * copies the hits into a preallocated slot and never locks or performs I/O. The writer thread drains all rings,
+ * serializes the records into a buffer and writes it out in large batches. If the writer falls behind and the ring of
+ * a worker is full, publishing waits until a slot is free, which bounds the memory used by pending events. After a
+ * failed write the writer keeps draining the rings so workers never wait for it, but drops the events; the first error
+ * is kept and reported by error() and print_statistics.
+ *
+ * Every event is stored as its event number (int32) and number of hits (uint32), followed by the columns edep, x, y, z
+ * and time (double each), the track ids and the plane indices (int32 each), all in native byte order.
+ */
+class HitWriter {
+public:
+    /**
+     * @brief Opens the output file and starts the writer thread
+     * @param path File to write the hits to
+     * @param ring_capacity Number of events every worker can publish before it has to wait for the writer
+     * @param batch_bytes Size of serialized data collected before it is written to the file
+     */
+    explicit HitWriter(const std::string& path, std::size_t ring_capacity = 64, std::size_t batch_bytes = 1 << 20)
+        : id_(next_id().fetch_add(1)), ring_capacity_(ring_capacity), batch_bytes_(batch_bytes) {
+        file_ = std::fopen(path.c_str(), "wb");
+        if(file_ == nullptr) {
+            throw std::runtime_error("cannot open hit output file " + path);
+        }
+        // The writer collects its own batches, without a second buffer a failed write is reported for its batch
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        buffer_.reserve(batch_bytes_ + (1 << 16));
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    HitWriter(const HitWriter&) = delete;
+    HitWriter& operator=(const HitWriter&) = delete;
+
+    /**
+     * @brief Closes the writer if that has not been done yet
+     */
+    ~HitWriter() { close(); }
+
+    /**
+     * @brief Writes all published events, stops the writer thread and closes the file
+     *
+     * No worker may publish events anymore once this has been called.
+     */
+    void close() {
+        if(!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stop_ = true;
+        }
+        condition_.notify_all();
+        thread_.join();
+        if(std::fclose(file_) != 0) {
+            fail("cannot close the hit output file");
+        }
+    }
+
+    /**
+     * @brief Return the first error writing the hits, empty if all events written so far made it to the file
+     *
+     * Buffered data is only known to be written once close() returned.
+     */
+    std::string error() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return error_;
+    }
+
+    /**
+     * @brief Queue the hits of an event for writing, called on the worker thread that simulated it
+     * @param event_id Number of the event
+     * @param hits Hits of the event, copied before the function returns
+     */
+    void publish(G4int event_id, const HitBuffer& hits) {
+        Ring& ring = local_ring();
+
+        Record* record = ring.try_acquire();
+        if(record == nullptr) {
+            // The writer is behind, wait for it instead of letting pending events grow without bound
+            stalls_.fetch_add(1, std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            for(unsigned int spins = 0; (record = ring.try_acquire()) == nullptr; ++spins) {
+                if(spins < 64) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+            stall_ns_.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()),
+                                std::memory_order_relaxed);
+        }
+
+        // Assigning reuses the capacity of the columns already in the slot
+        record->event_id = event_id;
+        record->hits = hits;
+        ring.commit();
+    }
+
+    /**
+     * @brief Print the number of written events and how often workers had to wait for the writer, and the first error
+     *        writing the file with the number of events lost to it
+     */
+    void print_statistics(std::ostream& output) const {
+        output << "Hit writer: " << events_.load() << " event(s), " << bytes_.load() << " bytes in " << writes_.load()
+               << " write(s), workers waited " << stalls_.load() << " time(s) for "
+               << static_cast<double>(stall_ns_.load()) * 1e-9 << " s\n";
+        std::string message = error();
+        if(!message.empty()) {
+            output << "Hit writer failed: " << message << ", " << lost_events_.load() << " event(s) lost\n";
+        }
+    }
+
+private:
+    struct Record {
+        G4int event_id{0};
+        HitBuffer hits;
+    };
+    using Ring = SpscRing<Record>;
+
+    // Ring of the calling thread, created on its first event
+    Ring& local_ring() {
+        struct Producer {
+            std::uint64_t writer_id;
+            Ring* ring;
+        };
+        static thread_local Producer producer{0, nullptr};
+        if(producer.ring == nullptr || producer.writer_id != id_) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            rings_.push_back(std::make_unique<Ring>(ring_capacity_));
+            producer = {id_, rings_.back().get()};
+            n_rings_.store(rings_.size(), std::memory_order_release);
+        }
+        return *producer.ring;
+    }
+
+    void run() {
+        std::vector<Ring*> rings;
+        while(true) {
+            // Read the stop flag first, every ring registered before it was set is picked up below
+            bool stopping;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                stopping = stop_;
+            }
+
+            // Pick up the rings of workers that started publishing
+            if(rings.size() != n_rings_.load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> lock{mutex_};
+                rings.clear();
+                for(const auto& ring : rings_) {
+                    rings.push_back(ring.get());
+                }
+            }
+
+            std::size_t drained = 0;
+            for(Ring* ring : rings) {
+                for(Record* record = ring->front(); record != nullptr; record = ring->front()) {
+                    serialize(*record);
+                    ring->pop();
+                    ++drained;
+                    if(buffer_.size() >= batch_bytes_) {
+                        flush();
+                    }
+                }
+            }
+
+            if(drained == 0) {
+                // Write out partial batches when idle, everything is published before stop_ is set
+                flush();
+                if(stopping) {
+                    break;
+                }
+                std::unique_lock<std::mutex> lock{mutex_};
+                condition_.wait_for(lock, std::chrono::milliseconds(1), [this]() { return stop_; });
+            }
+        }
+        if(std::fflush(file_) != 0) {
+            fail("cannot write the hit output file");
+        }
+    }
+
+    // Keep the first error, the ones following it are usually caused by it
+    void fail(const char* what) {
+        std::string message = std::string(what) + ": " + std::strerror(errno);
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(error_.empty()) {
+            error_ = message;
+        }
+    }
+
+    template <typename V> void append(const V* data, std::size_t count) {
+        const auto* bytes = reinterpret_cast<const char*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + count * sizeof(V));
+    }
+
+    void serialize(const Record& record) {
+        std::int32_t event_id = record.event_id;
+        auto n_hits = static_cast<std::uint32_t>(record.hits.size());
+        append(&event_id, 1);
+        append(&n_hits, 1);
+        append(record.hits.edep().data(), n_hits);
+        append(record.hits.x().data(), n_hits);
+        append(record.hits.y().data(), n_hits);
+        append(record.hits.z().data(), n_hits);
+        append(record.hits.time().data(), n_hits);
+        append(record.hits.track_id().data(), n_hits);
+        append(record.hits.plane().data(), n_hits);
+        ++buffer_events_;
+    }
+
+    // Write the buffer out, its events are only counted as written if all of it made it to the file. Nothing is
+    // written after an error, a partial event in the middle of the file would make the rest unreadable.
+    void flush() {
+        if(buffer_.empty()) {
+            return;
+        }
+        if(!failed_) {
+            std::size_t written = std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+            bytes_.fetch_add(written, std::memory_order_relaxed);
+            writes_.fetch_add(1, std::memory_order_relaxed);
+            if(written != buffer_.size()) {
+                failed_ = true;
+                fail("cannot write the hit output file");
+            }
+        }
+        (failed_ ? lost_events_ : events_).fetch_add(buffer_events_, std::memory_order_relaxed);
+        buffer_events_ = 0;
+        buffer_.clear();
+    }
+
+    static std::atomic<std::uint64_t>& next_id() {
+        static std::atomic<std::uint64_t> id{1};
+        return id;
+    }
+
+    std::uint64_t id_;
+    std::size_t ring_capacity_;
+    std::size_t batch_bytes_;
+    std::FILE* file_{nullptr};
+
+    // Rings of all producers, only appended to under the mutex
+    std::vector<std::unique_ptr<Ring>> rings_;
+    std::atomic<std::size_t> n_rings_{0};
+
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stop_{false};
+    // First error writing the file, empty without errors
+    std::string error_;
+
+    // Only used by the writer thread
+    std::vector<char> buffer_;
+    std::uint64_t buffer_events_{0};
+    bool failed_{false};
+
+    std::atomic<std::uint64_t> events_{0};
+    std::atomic<std::uint64_t> lost_events_{0};
+    std::atomic<std::uint64_t> bytes_{0};
+    std::atomic<std::uint64_t> writes_{0};
+    std::atomic<std::uint64_t> stalls_{0};
+    std::atomic<std::uint64_t> stall_ns_{0};
+
+    std::thread thread_;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <tuple>
+#include <vector>
+
+#include "presampled.hpp"
+#include "../tools/BatchGaussian.hpp"
+#include "../tools/CounterSeeds.hpp"
+#include "../tools/SubEvent.hpp"
+
+#include <G4Event.hh>
+#include <G4ParticleTable.hh>
+#include <G4PrimaryParticle.hh>
+#include <G4PrimaryVertex.hh>
+#include <G4VUserPrimaryGeneratorAction.hh>
+
+/**
+ * @brief Generates events with many beam particles that can be split into sub-events
+ *
+ * Every particle gets its own vertex with the same beam profile and energy distribution as PresampledGeneratorActionG4.
+ * The kinematics of particle p of an event come from the keys 4p ... 4p + 3 of the event in stream
+ * PresampledGeneratorActionG4::primary_stream, so the first particle matches the pre-sampled generator and every
+ * particle is the same no matter how the event is split. Inside a sub-event (SubEventSlice) only the particles of the
+ * slice are generated.
+ */
+class MultiParticleGeneratorActionG4 : public G4VUserPrimaryGeneratorAction {
+public:
+    /**
+     * @brief Constructs the generator action
+     * @param energy Mean energy of the beam particles
+     * @param master_seed Seed all primaries are derived from
+     * @param multiplicity Number of particles of a whole event
+     * @param beam_sigma Width of the transverse beam profile
+     * @param energy_sigma Width of the energy distribution
+     */
+    MultiParticleGeneratorActionG4(double energy, std::uint64_t master_seed, std::size_t multiplicity, double beam_sigma = 1.,
+                                   double energy_sigma = 0.)
+        : energy_(energy), beam_sigma_(beam_sigma), energy_sigma_(energy_sigma), seeds_(master_seed),
+          multiplicity_(multiplicity > 0 ? multiplicity : 1), particle_(G4ParticleTable::GetParticleTable()->FindParticle("pi+")) {
+        for(auto* column : {&u1_, &u2_, &u3_, &u4_, &x_, &y_, &z_energy_, &unused_}) {
+            column->resize(multiplicity_);
+        }
+        bits_.resize(multiplicity_);
+    }
+
+    /**
+     * @brief Add the particles of the event, or of the current slice of it
+     */
+    void GeneratePrimaries(G4Event* event) override {
+        std::size_t first = 0;
+        std::size_t last = multiplicity_;
+        const SubEventSlice& slice = SubEventSlice::current();
+        if(slice.active) {
+            std::tie(first, last) = slice.range(multiplicity_);
+        }
+        std::size_t n = last - first;
+
+        fill_uniform(event->GetEventID(), first, n, 0, u1_);
+        fill_uniform(event->GetEventID(), first, n, 1, u2_);
+        fill_uniform(event->GetEventID(), first, n, 2, u3_);
+        fill_uniform(event->GetEventID(), first, n, 3, u4_);
+        BatchGaussian::box_muller(u1_.data(), u2_.data(), x_.data(), y_.data(), n);
+        BatchGaussian::box_muller(u3_.data(), u4_.data(), z_energy_.data(), unused_.data(), n);
+
+        for(std::size_t i = 0; i < n; ++i) {
+            auto particle = new G4PrimaryParticle(particle_);
+            particle->SetMomentumDirection(G4ThreeVector(0, 0, 1));
+            particle->SetKineticEnergy(energy_ + energy_sigma_ * z_energy_[i]);
+
+            auto vertex = new G4PrimaryVertex(G4ThreeVector(beam_sigma_ * x_[i], beam_sigma_ * y_[i], 0), 0);
+            vertex->SetPrimary(particle);
+            event->AddPrimaryVertex(vertex);
+        }
+    }
+
+private:
+    // Draw the uniform number with the given index for the particles first ... first + n - 1
+    void fill_uniform(std::int64_t event, std::size_t first, std::size_t n, std::uint32_t index, std::vector<double>& out) {
+        for(std::size_t i = 0; i < n; ++i) {
+            auto key_index = static_cast<std::uint32_t>(4 * (first + i)) + index;
+            bits_[i] = seeds_.key(event, key_index, PresampledGeneratorActionG4::primary_stream);
+        }
+        BatchGaussian::to_unit(bits_.data(), out.data(), n);
+    }
+
+    double energy_;
+    double beam_sigma_;
+    double energy_sigma_;
+    CounterSeeds seeds_;
+    std::size_t multiplicity_;
+    G4ParticleDefinition* particle_;
+
+    // Sampling buffers for one event, owned by the worker thread using this action
+    std::vector<std::uint64_t> bits_;
+    std::vector<double> u1_, u2_, u3_, u4_;
+    std::vector<double> x_, y_, z_energy_, unused_;
+};
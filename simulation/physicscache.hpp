@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/stat.h>
+
+#include <G4Element.hh>
+#include <G4Material.hh>
+#include <G4ProductionCuts.hh>
+#include <G4Region.hh>
+#include <G4RegionStore.hh>
+#include <G4VModularPhysicsList.hh>
+#include <G4VPhysicsConstructor.hh>
+#include <G4Version.hh>
+
+/**
+ * @brief Persistent cache of the physics tables built by the master, to skip rebuilding them on every start
+ *
+ * Every configuration gets its own subdirectory of the cache directory, named by a hash of the Geant4 version, the
+ * physics list and its constructors, the production cuts of all regions and the composition of all materials. A
+ * changed configuration therefore never picks up stale tables, it simply misses the cache. The tables are stored
+ * with G4VUserPhysicsList::StorePhysicsTable after the first start and retrieved with SetPhysicsTableRetrieved on
+ * later starts; a marker file written last makes sure only completely stored tables are used, also when several
+ * processes share the cache. The marker also records the startup time of the start that stored the tables and what that
+ * startup covered, so a saving is only reported against a startup of the same kind.
+ *
+ * The cache has to be created after the geometry and the physics list are initialized, since the key depends on the
+ * materials and regions, and before the physics tables are built.
+ */
+class PhysicsTableCache {
+public:
+    /**
+     * @brief Selects the subdirectory of the current configuration and enables retrieval if its tables are complete
+     * @param directory Cache directory, created if it does not exist
+     * @param physics_list_name Name of the reference physics list
+     * @param physics_list Initialized physics list the tables belong to
+     */
+    PhysicsTableCache(const std::string& directory, const std::string& physics_list_name, G4VModularPhysicsList* physics_list)
+        : physics_list_(physics_list) {
+        std::string description = Describe(physics_list_name, physics_list);
+        std::stringstream key;
+        key << std::hex << std::setw(16) << std::setfill('0') << hash(description);
+        directory_ = directory + "/" + key.str();
+
+        std::ifstream marker(marker_path());
+        if(marker >> stored_seconds_) {
+            std::getline(marker >> std::ws, stored_startup_);
+            retrieved_ = true;
+            physics_list_->SetPhysicsTableRetrieved(directory_);
+        } else {
+            make_directory(directory);
+            make_directory(directory_);
+            std::ofstream(directory_ + "/configuration.txt") << description;
+        }
+    }
+
+    /**
+     * @brief Create the cache in the directory named by the environment variable G4MT_PHYSICS_CACHE
+     * @return The cache, or nullptr if the variable is not set and the tables are always built
+     */
+    static std::unique_ptr<PhysicsTableCache> FromEnvironment(const std::string& physics_list_name,
+                                                              G4VModularPhysicsList* physics_list) {
+        const char* directory = std::getenv("G4MT_PHYSICS_CACHE");
+        if(directory == nullptr || *directory == '\0') {
+            return nullptr;
+        }
+        return std::make_unique<PhysicsTableCache>(directory, physics_list_name, physics_list);
+    }
+
+    /**
+     * @brief Return the subdirectory holding the tables of the current configuration
+     */
+    const std::string& Directory() const { return directory_; }
+
+    /**
+     * @brief Return true if the tables are retrieved from the cache instead of being built
+     */
+    bool Retrieved() const { return retrieved_; }
+
+    /**
+     * @brief Store the built tables on a cache miss and report the startup time
+     * @param init_seconds Time the initialization including the table construction took
+     * @param startup What the startup time covers, e.g. the executable and its execution model. The saving on a cache
+     *                hit is only reported if the tables were stored by a startup with the same description.
+     * @param output Stream the report is written to
+     *
+     * Must be called after the physics tables have been built, i.e. after the first BeamOn, which for G4MTRunManager
+     * happens in Initialize.
+     */
+    void Finish(double init_seconds, const std::string& startup, std::ostream& output) {
+        if(retrieved_) {
+            output << "Physics tables retrieved from " << directory_ << ", startup took " << init_seconds << " s";
+            if(startup == stored_startup_) {
+                output << " instead of " << stored_seconds_ << " s, " << stored_seconds_ - init_seconds << " s saved.\n";
+            } else {
+                // A different run manager or number of threads does different work during its startup
+                output << ", the tables were stored by " << (stored_startup_.empty() ? "an unknown startup" : stored_startup_)
+                       << " which is not comparable.\n";
+            }
+            return;
+        }
+
+        if(!physics_list_->StorePhysicsTable(directory_)) {
+            output << "Could not store the physics tables in " << directory_ << ".\n";
+            return;
+        }
+        // Written to a temporary file and renamed, so no other process sees an incomplete marker
+        std::string temporary = marker_path() + ".tmp";
+        std::ofstream(temporary) << init_seconds << " " << startup << "\n";
+        std::rename(temporary.c_str(), marker_path().c_str());
+        output << "Physics tables built in " << init_seconds << " s and stored in " << directory_ << ".\n";
+    }
+
+    /**
+     * @brief Return the description of the configuration the tables depend on, the cache key is its hash
+     */
+    static std::string Describe(const std::string& physics_list_name, const G4VModularPhysicsList* physics_list) {
+        std::stringstream description;
+        description << std::setprecision(17) << G4Version << "\n" << physics_list_name << "\n";
+        for(G4int i = 0; physics_list->GetPhysics(i) != nullptr; ++i) {
+            description << "physics " << physics_list->GetPhysics(i)->GetPhysicsName() << "\n";
+        }
+
+        description << "default cut " << physics_list->GetDefaultCutValue() << "\n";
+        for(const G4Region* region : *G4RegionStore::GetInstance()) {
+            description << "region " << region->GetName();
+            const G4ProductionCuts* cuts = region->GetProductionCuts();
+            if(cuts != nullptr) {
+                for(G4int particle = 0; particle < 4; ++particle) {
+                    description << " " << cuts->GetProductionCut(particle);
+                }
+            }
+            description << "\n";
+        }
+
+        for(const G4Material* material : *G4Material::GetMaterialTable()) {
+            description << "material " << material->GetName() << " " << material->GetDensity();
+            const G4double* fractions = material->GetFractionVector();
+            for(std::size_t i = 0; i < material->GetNumberOfElements(); ++i) {
+                description << " " << material->GetElement(static_cast<G4int>(i))->GetName() << " " << fractions[i];
+            }
+            description << "\n";
+        }
+        return description.str();
+    }
+
+private:
+    // 64 bit FNV-1a
+    static std::uint64_t hash(const std::string& text) {
+        std::uint64_t value = 14695981039346656037ull;
+        for(char c : text) {
+            value = (value ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return value;
+    }
+
+    static void make_directory(const std::string& path) {
+        if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw std::runtime_error("cannot create physics table cache directory " + path);
+        }
+    }
+
+    std::string marker_path() const { return directory_ + "/complete"; }
+
+    G4VModularPhysicsList* physics_list_;
+    std::string directory_;
+    bool retrieved_{false};
+    // Startup time of the run that stored the tables and what it covered
+    double stored_seconds_{0};
+    std::string stored_startup_;
+};
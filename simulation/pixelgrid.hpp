@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <G4Types.hh>
+
+/**
+ * @brief Dense charge map of the pixels of all sensor planes, owned by a single worker
+ *
+ * The charge of every plane is a contiguous row-major array of columns x rows pixels, so adding a deposit is a single
+ * indexed addition without any lookup. Planes are allocated when their first deposit arrives. The flat index of every
+ * pixel receiving its first charge of the event is recorded, so reading out and resetting the grid only visits the
+ * pixels that were hit, never the whole array.
+ */
+class PixelGrid {
+public:
+    /**
+     * @brief Constructs the grid covering a sensor centred around its local origin
+     * @param half_x Half width of the sensor along local x
+     * @param half_y Half width of the sensor along local y
+     * @param pitch Size of a square pixel
+     */
+    PixelGrid(double half_x, double half_y, double pitch)
+        : half_x_(half_x), half_y_(half_y), pitch_(pitch), columns_(cells(half_x, pitch)), rows_(cells(half_y, pitch)) {}
+
+    std::size_t columns() const { return columns_; }
+    std::size_t rows() const { return rows_; }
+    double pitch() const { return pitch_; }
+
+    /**
+     * @brief Return the number of pixels with charge since the last read out
+     */
+    std::size_t touched() const { return touched_.size(); }
+
+    /**
+     * @brief Add a deposit to the pixel containing the given local position
+     * @param plane Index of the sensor plane
+     * @param x Local x position of the deposit, positions outside the sensor end up in the edge pixels
+     * @param y Local y position of the deposit
+     * @param charge Deposited energy, has to be positive
+     * @param time Global time of the deposit, the pixel keeps the earliest one
+     * @param track_id Track causing the deposit, the pixel keeps the track of its first deposit
+     */
+    void add(G4int plane, double x, double y, double charge, double time, G4int track_id) {
+        std::size_t pixel = (plane_offset(plane) + bin(y, half_y_, rows_) * columns_) + bin(x, half_x_, columns_);
+        if(charge_[pixel] == 0) {
+            touched_.push_back(static_cast<std::uint32_t>(pixel));
+            time_[pixel] = time;
+            track_id_[pixel] = track_id;
+        } else {
+            time_[pixel] = std::min(time_[pixel], time);
+        }
+        charge_[pixel] += charge;
+    }
+
+    /**
+     * @brief Hand every pixel with charge to the function and reset it
+     * @param readout Function called as readout(plane, x, y, charge, time, track_id) with the local pixel centre
+     *
+     * Pixels are read out in the order they received their first charge.
+     */
+    template <typename Readout> void read_out(Readout&& readout) {
+        std::size_t plane_size = columns_ * rows_;
+        for(std::uint32_t pixel : touched_) {
+            std::size_t in_plane = pixel % plane_size;
+            double x = -half_x_ + (static_cast<double>(in_plane % columns_) + 0.5) * pitch_;
+            double y = -half_y_ + (static_cast<double>(in_plane / columns_) + 0.5) * pitch_;
+            readout(static_cast<G4int>(pixel / plane_size), x, y, charge_[pixel], time_[pixel], track_id_[pixel]);
+            charge_[pixel] = 0;
+        }
+        touched_.clear();
+    }
+
+private:
+    static std::size_t cells(double half_width, double pitch) {
+        return static_cast<std::size_t>(std::max(1., std::ceil(2 * half_width / pitch)));
+    }
+
+    // Index of the pixel along one axis, clamped to the grid
+    std::size_t bin(double position, double half_width, std::size_t cells) const {
+        auto index = static_cast<long>(std::floor((position + half_width) / pitch_));
+        return static_cast<std::size_t>(std::min(std::max(index, 0L), static_cast<long>(cells) - 1));
+    }
+
+    // Flat index of the first pixel of the plane, allocating the planes up to it
+    std::size_t plane_offset(G4int plane) {
+        std::size_t plane_size = columns_ * rows_;
+        auto needed = (static_cast<std::size_t>(plane) + 1) * plane_size;
+        if(charge_.size() < needed) {
+            charge_.resize(needed, 0.);
+            time_.resize(needed, 0.);
+            track_id_.resize(needed, 0);
+        }
+        return static_cast<std::size_t>(plane) * plane_size;
+    }
+
+    double half_x_;
+    double half_y_;
+    double pitch_;
+    std::size_t columns_;
+    std::size_t rows_;
+
+    std::vector<double> charge_;
+    std::vector<double> time_;
+    std::vector<G4int> track_id_;
+    std::vector<std::uint32_t> touched_;
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+#include <G4Step.hh>
+#include <G4StepPoint.hh>
+#include <G4ThreeVector.hh>
+#include <G4Track.hh>
+#include <G4UserStackingAction.hh>
+#include <G4UserSteppingAction.hh>
+
+/**
+ * @brief Rules of the performance policy, every rule is disabled by default
+ */
+struct PolicyConfig {
+    // Secondaries created below this kinetic energy are killed, zero disables the rule
+    double min_secondary_energy{0.};
+    // Kill secondaries whose straight line from their vertex misses the box containing all sensors
+    bool kill_unreachable{false};
+    // Tracks are killed once they leave the box around the sensors and the beam origin grown by this margin, negative
+    // disables the rule
+    double roi_margin{-1.};
+    // Do not kill anything, only record what the rules would kill and the steps and time spent on it
+    bool measure_only{false};
+    // Box containing all sensors, see GeometryConstructionG4::SensorBounds
+    G4ThreeVector sensor_low;
+    G4ThreeVector sensor_high;
+
+    /**
+     * @brief Return true if any rule is enabled
+     */
+    bool enabled() const { return min_secondary_energy > 0 || kill_unreachable || roi_margin >= 0; }
+};
+
+/**
+ * @brief Stops the transport of particles that cannot contribute to the sensor read out
+ *
+ * Secondaries below an energy threshold or flying away from the sensors are killed by PerformancePolicyStackingAction
+ * before they are ever tracked, and tracks leaving the region of interest are killed by this stepping action. The
+ * straight-line reachability ignores multiple scattering, which is the approximation the rule trades for speed.
+ *
+ * Every worker owns its own instance and merges its statistics when the worker destroys its user actions, like the
+ * SteppingProfiler. In measure-only mode nothing is killed: the tracks a rule would have killed and all their
+ * descendants are followed instead, and their steps and the time spent on them are the savings of the rule.
+ */
+class PerformancePolicy : public G4UserSteppingAction {
+public:
+    /**
+     * @brief Rules of the policy
+     */
+    enum class Rule : std::size_t { LowEnergy, Unreachable, LeftRegion, Count };
+    static constexpr std::size_t n_rules = static_cast<std::size_t>(Rule::Count);
+
+    /**
+     * @brief What a rule killed, and in measure-only mode what that saves
+     */
+    struct Totals {
+        std::uint64_t tracks{0};
+        double energy{0};
+        std::uint64_t steps{0};
+        double seconds{0};
+    };
+
+    static const char* rule_name(Rule rule) {
+        static const char* names[] = {"low_energy", "unreachable", "left_region"};
+        return names[static_cast<std::size_t>(rule)];
+    }
+
+    explicit PerformancePolicy(const PolicyConfig& config) : config_(config) {
+        // The region of interest also contains the beam origin, otherwise the primaries are killed right away
+        G4ThreeVector margin(config.roi_margin, config.roi_margin, config.roi_margin);
+        roi_low_ = G4ThreeVector(std::min(config.sensor_low.x(), 0.), std::min(config.sensor_low.y(), 0.),
+                                 std::min(config.sensor_low.z(), 0.)) - margin;
+        roi_high_ = G4ThreeVector(std::max(config.sensor_high.x(), 0.), std::max(config.sensor_high.y(), 0.),
+                                  std::max(config.sensor_high.z(), 0.)) + margin;
+    }
+
+    /**
+     * @brief Merge the statistics of this thread into the global totals
+     */
+    ~PerformancePolicy() override {
+        std::lock_guard<std::mutex> lock{merged_mutex()};
+        for(std::size_t rule = 0; rule < n_rules; ++rule) {
+            merged()[rule].tracks += totals_[rule].tracks;
+            merged()[rule].energy += totals_[rule].energy;
+            merged()[rule].steps += totals_[rule].steps;
+            merged()[rule].seconds += totals_[rule].seconds;
+        }
+    }
+
+    /**
+     * @brief Forget the tracks of the previous event, called when a new event starts
+     */
+    void BeginEvent() {
+        tagged_.clear();
+        current_track_ = -1;
+        last_step_ = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * @brief Decide whether a new track is transported
+     * @return True if the track has to be killed
+     */
+    bool ClassifyTrack(const G4Track* track) {
+        if(config_.measure_only) {
+            // Descendants of tracks a rule would have killed would never have existed
+            auto parent = tagged_.find(track->GetParentID());
+            if(parent != tagged_.end()) {
+                tagged_[track->GetTrackID()] = parent->second;
+                return false;
+            }
+        }
+        if(track->GetParentID() == 0) {
+            return false;
+        }
+
+        if(track->GetKineticEnergy() < config_.min_secondary_energy) {
+            return apply(Rule::LowEnergy, track);
+        }
+        if(config_.kill_unreachable && !reaches_sensors(track->GetPosition(), track->GetMomentumDirection())) {
+            return apply(Rule::Unreachable, track);
+        }
+        return false;
+    }
+
+    /**
+     * @brief Kill tracks leaving the region of interest and account the steps of tagged tracks
+     */
+    void UserSteppingAction(const G4Step* step) override {
+        G4Track* track = step->GetTrack();
+        if(config_.measure_only) {
+            measure(track);
+        }
+
+        if(config_.roi_margin >= 0 && !in_region(step->GetPostStepPoint()->GetPosition())) {
+            if(!config_.measure_only) {
+                apply(Rule::LeftRegion, track);
+                track->SetTrackStatus(fStopAndKill);
+            } else if(current_rule_ == nullptr) {
+                apply(Rule::LeftRegion, track);
+                current_rule_ = &totals_[static_cast<std::size_t>(Rule::LeftRegion)];
+            }
+        }
+    }
+
+    /**
+     * @brief Return the totals of every rule merged from all finished workers
+     */
+    static std::array<Totals, n_rules> Results() {
+        std::lock_guard<std::mutex> lock{merged_mutex()};
+        return merged();
+    }
+
+    /**
+     * @brief Print what every rule killed and, in measure-only mode, the steps and time it saves
+     */
+    static void Print(std::ostream& output) {
+        auto results = Results();
+        output << "Performance policy\n";
+        for(std::size_t rule = 0; rule < n_rules; ++rule) {
+            output << "  " << rule_name(static_cast<Rule>(rule)) << ": " << results[rule].tracks << " track(s) with "
+                   << results[rule].energy << " MeV, " << results[rule].steps << " step(s) and " << results[rule].seconds
+                   << " s saved\n";
+        }
+    }
+
+    /**
+     * @brief Clear the merged totals
+     */
+    static void Reset() {
+        std::lock_guard<std::mutex> lock{merged_mutex()};
+        merged() = {};
+    }
+
+private:
+    // Record a rule firing for the track, returns whether the track has to be killed
+    bool apply(Rule rule, const G4Track* track) {
+        Totals& totals = totals_[static_cast<std::size_t>(rule)];
+        ++totals.tracks;
+        totals.energy += track->GetKineticEnergy();
+        if(config_.measure_only) {
+            tagged_[track->GetTrackID()] = rule;
+            return false;
+        }
+        return true;
+    }
+
+    // Account the step and the time since the previous step to the rule that would have killed the track
+    void measure(const G4Track* track) {
+        auto now = std::chrono::steady_clock::now();
+        if(track->GetTrackID() != current_track_) {
+            current_track_ = track->GetTrackID();
+            auto tag = tagged_.find(current_track_);
+            current_rule_ = (tag != tagged_.end() ? &totals_[static_cast<std::size_t>(tag->second)] : nullptr);
+        }
+        if(current_rule_ != nullptr) {
+            ++current_rule_->steps;
+            current_rule_->seconds += std::chrono::duration<double>(now - last_step_).count();
+        }
+        last_step_ = now;
+    }
+
+    bool in_region(const G4ThreeVector& position) const {
+        return position.x() >= roi_low_.x() && position.x() <= roi_high_.x() && position.y() >= roi_low_.y() &&
+               position.y() <= roi_high_.y() && position.z() >= roi_low_.z() && position.z() <= roi_high_.z();
+    }
+
+    // Slab test of the ray from the position along the direction against the box containing all sensors
+    bool reaches_sensors(const G4ThreeVector& position, const G4ThreeVector& direction) const {
+        double near = 0;
+        double far = std::numeric_limits<double>::infinity();
+        for(int axis = 0; axis < 3; ++axis) {
+            double origin = position[axis];
+            double low = config_.sensor_low[axis];
+            double high = config_.sensor_high[axis];
+            if(direction[axis] == 0) {
+                if(origin < low || origin > high) {
+                    return false;
+                }
+                continue;
+            }
+            double t1 = (low - origin) / direction[axis];
+            double t2 = (high - origin) / direction[axis];
+            near = std::max(near, std::min(t1, t2));
+            far = std::min(far, std::max(t1, t2));
+            if(near > far) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::mutex& merged_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+    static std::array<Totals, n_rules>& merged() {
+        static std::array<Totals, n_rules> totals;
+        return totals;
+    }
+
+    PolicyConfig config_;
+    G4ThreeVector roi_low_;
+    G4ThreeVector roi_high_;
+    std::array<Totals, n_rules> totals_;
+
+    // Tracks a rule would have killed in measure-only mode, and the rule of the track currently stepping
+    std::unordered_map<G4int, Rule> tagged_;
+    G4int current_track_{-1};
+    Totals* current_rule_{nullptr};
+    std::chrono::steady_clock::time_point last_step_;
+};
+
+/**
+ * @brief Applies the secondary rules of the performance policy when tracks are created
+ */
+class PerformancePolicyStackingAction : public G4UserStackingAction {
+public:
+    explicit PerformancePolicyStackingAction(PerformancePolicy* policy) : policy_(policy) {}
+
+    G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track* track) override {
+        return policy_->ClassifyTrack(track) ? fKill : fUrgent;
+    }
+
+    void PrepareNewEvent() override { policy_->BeginEvent(); }
+
+private:
+    PerformancePolicy* policy_;
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "../tools/BatchGaussian.hpp"
+#include "../tools/CounterSeeds.hpp"
+
+#include <G4Event.hh>
+#include <G4ParticleTable.hh>
+#include <G4PrimaryParticle.hh>
+#include <G4PrimaryVertex.hh>
+#include <G4VUserPrimaryGeneratorAction.hh>
+
+/**
+ * @brief Generates the same beam as GeneratorActionG4 from kinematics pre-sampled in blocks of events
+ *
+ * The beam particles start at z = 0 with a Gaussian transverse profile and fly along z, the energy is Gaussian around
+ * the mean energy. Instead of drawing these from the engine through the particle source one event at a time, every
+ * worker samples the kinematics of a whole block of consecutive event numbers at once into its own buffers, and every
+ * event only copies its vertex out. The random numbers of an event are derived from the master seed and the event
+ * number only (CounterSeeds stream primary_stream), like the event seeds in counter seeding mode. The primaries are
+ * therefore bit-identical regardless of the block size, the thread that simulates the event and the order of events,
+ * and the engine stream of the event is left to the physics.
+ *
+ * The event number is the event ID, unless CountEvents numbers the events in the order this action generates them.
+ */
+class PresampledGeneratorActionG4 : public G4VUserPrimaryGeneratorAction {
+public:
+    /**
+     * @brief Stream of the counter-based keys used for the primaries, the event seeds use stream 0
+     */
+    static constexpr std::uint32_t primary_stream = 1;
+
+    /**
+     * @brief Constructs the generator action
+     * @param energy Mean energy of the beam particles
+     * @param master_seed Seed all primaries are derived from
+     * @param block_size Number of consecutive event numbers sampled at once
+     * @param beam_sigma Width of the transverse beam profile
+     * @param energy_sigma Width of the energy distribution, zero gives the mean energy like the particle source
+     */
+    PresampledGeneratorActionG4(double energy, std::uint64_t master_seed, std::size_t block_size = 256, double beam_sigma = 1.,
+                                double energy_sigma = 0.)
+        : energy_(energy), beam_sigma_(beam_sigma), energy_sigma_(energy_sigma), seeds_(master_seed),
+          block_size_(block_size > 0 ? block_size : 1), particle_(G4ParticleTable::GetParticleTable()->FindParticle("pi+")) {
+        for(auto* column : {&u1_, &u2_, &u3_, &u4_, &x_, &y_, &z_energy_, &unused_}) {
+            column->resize(block_size_);
+        }
+        bits_.resize(block_size_);
+    }
+
+    /**
+     * @brief Number the events in the order they are generated instead of by their event ID
+     * @param first Number of the next event generated by this action
+     *
+     * For run managers that start every run at event ID 0, like a sequential run manager simulating one event per
+     * BeamOn, which would otherwise give every event the same primaries.
+     */
+    void CountEvents(std::int64_t first) {
+        counting_ = true;
+        next_event_ = first;
+    }
+
+    /**
+     * @brief Add the pre-sampled vertex of the event, sampling the block containing it if needed
+     */
+    void GeneratePrimaries(G4Event* event) override {
+        std::int64_t event_id = (counting_ ? next_event_++ : event->GetEventID());
+        auto block_size = static_cast<std::int64_t>(block_size_);
+        if(!sampled_ || event_id < block_first_ || event_id >= block_first_ + block_size) {
+            // Blocks are aligned so workers processing consecutive events hit the same block
+            std::int64_t offset = event_id % block_size;
+            sample_block(event_id - (offset < 0 ? offset + block_size : offset));
+        }
+
+        auto i = static_cast<std::size_t>(event_id - block_first_);
+        auto particle = new G4PrimaryParticle(particle_);
+        particle->SetMomentumDirection(G4ThreeVector(0, 0, 1));
+        particle->SetKineticEnergy(energy_ + energy_sigma_ * z_energy_[i]);
+
+        auto vertex = new G4PrimaryVertex(G4ThreeVector(beam_sigma_ * x_[i], beam_sigma_ * y_[i], 0), 0);
+        vertex->SetPrimary(particle);
+        event->AddPrimaryVertex(vertex);
+    }
+
+private:
+    // Sample the kinematics of the events first ... first + block_size_ - 1
+    void sample_block(std::int64_t first) {
+        fill_uniform(first, 0, u1_);
+        fill_uniform(first, 1, u2_);
+        fill_uniform(first, 2, u3_);
+        fill_uniform(first, 3, u4_);
+
+        // One pair of normal numbers for the transverse position and one for the energy
+        BatchGaussian::box_muller(u1_.data(), u2_.data(), x_.data(), y_.data(), block_size_);
+        BatchGaussian::box_muller(u3_.data(), u4_.data(), z_energy_.data(), unused_.data(), block_size_);
+
+        block_first_ = first;
+        sampled_ = true;
+    }
+
+    // Draw the uniform number with the given index for every event of the block
+    void fill_uniform(std::int64_t first, std::uint32_t index, std::vector<double>& out) {
+        for(std::size_t i = 0; i < block_size_; ++i) {
+            bits_[i] = seeds_.key(first + static_cast<std::int64_t>(i), index, primary_stream);
+        }
+        BatchGaussian::to_unit(bits_.data(), out.data(), block_size_);
+    }
+
+    double energy_;
+    double beam_sigma_;
+    double energy_sigma_;
+    CounterSeeds seeds_;
+    std::size_t block_size_;
+    G4ParticleDefinition* particle_;
+
+    // Number of the next event if the events are counted instead of taken from the event ID
+    bool counting_{false};
+    std::int64_t next_event_{0};
+
+    // Pre-sampled block, owned by the worker thread using this action
+    bool sampled_{false};
+    std::int64_t block_first_{0};
+    std::vector<std::uint64_t> bits_;
+    std::vector<double> u1_, u2_, u3_, u4_;
+    std::vector<double> x_, y_, z_energy_, unused_;
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <ctime>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <G4LogicalVolume.hh>
+#include <G4ParticleDefinition.hh>
+#include <G4Step.hh>
+#include <G4StepPoint.hh>
+#include <G4Track.hh>
+#include <G4UserSteppingAction.hh>
+#include <G4UserTrackingAction.hh>
+#include <G4VPhysicalVolume.hh>
+#include <G4VProcess.hh>
+
+/**
+ * @brief Counts the steps and the CPU time spent per logical volume, particle type and limiting process
+ *
+ * Every worker owns its own instance with a flat open-addressing table keyed by pointers, so the stepping path neither
+ * locks nor allocates once all combinations have been seen. The time of a step is the CPU time the thread consumed
+ * since the previous step of the same track, or since the track started, so preemption and waiting are not charged to
+ * the step. The table is merged into a global one by name when the worker's user actions are destroyed, i.e. when the
+ * worker itself is destroyed, since processes are separate objects on every thread.
+ */
+class SteppingProfiler : public G4UserSteppingAction {
+public:
+    /**
+     * @brief Merged statistics of a single combination
+     */
+    struct Entry {
+        std::string volume;
+        std::string particle;
+        std::string process;
+        std::uint64_t steps;
+        double seconds;
+    };
+
+    SteppingProfiler() : slots_(initial_capacity) {}
+
+    /**
+     * @brief Merge the statistics of this thread into the global table
+     */
+    ~SteppingProfiler() override {
+        std::lock_guard<std::mutex> lock{merged_mutex()};
+        for(const auto& slot : slots_) {
+            if(!slot.used) {
+                continue;
+            }
+            auto& totals = merged()[std::make_tuple(volume_name(slot.key.volume),
+                                                    slot.key.particle != nullptr ? std::string(slot.key.particle->GetParticleName()) : "unknown",
+                                                    slot.key.process != nullptr ? std::string(slot.key.process->GetProcessName()) : "none")];
+            totals.first += slot.steps;
+            totals.second += slot.nanoseconds;
+        }
+    }
+
+    /**
+     * @brief Restart the step clock, called when a new track starts
+     */
+    void StartTrack() { last_step_ = thread_cpu_nanoseconds(); }
+
+    /**
+     * @brief Account the CPU time since the previous step to the volume, particle and process of this step
+     */
+    void UserSteppingAction(const G4Step* step) override {
+        std::uint64_t now = thread_cpu_nanoseconds();
+        const G4VPhysicalVolume* volume = step->GetPreStepPoint()->GetPhysicalVolume();
+        Key key{volume != nullptr ? volume->GetLogicalVolume() : nullptr, step->GetTrack()->GetDefinition(),
+                step->GetPostStepPoint()->GetProcessDefinedStep()};
+
+        Slot& slot = find(key);
+        ++slot.steps;
+        slot.nanoseconds += now - last_step_;
+        last_step_ = now;
+    }
+
+    /**
+     * @brief Return the statistics merged from all finished workers, most expensive first
+     */
+    static std::vector<Entry> Results() {
+        std::lock_guard<std::mutex> lock{merged_mutex()};
+        std::vector<Entry> entries;
+        for(const auto& item : merged()) {
+            entries.push_back({std::get<0>(item.first), std::get<1>(item.first), std::get<2>(item.first), item.second.first,
+                               static_cast<double>(item.second.second) * 1e-9});
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.seconds > b.seconds; });
+        return entries;
+    }
+
+    /**
+     * @brief Print the totals per volume followed by the most expensive combinations
+     * @param output Stream to print to
+     * @param max_entries Maximum number of combinations to print
+     */
+    static void Print(std::ostream& output, std::size_t max_entries = 20) {
+        auto entries = Results();
+        double total_seconds = 0;
+        std::map<std::string, std::pair<std::uint64_t, double>> volumes;
+        for(const auto& entry : entries) {
+            total_seconds += entry.seconds;
+            volumes[entry.volume].first += entry.steps;
+            volumes[entry.volume].second += entry.seconds;
+        }
+
+        auto percent = [total_seconds](double seconds) { return total_seconds > 0 ? 100. * seconds / total_seconds : 0.; };
+        output << "Stepping profile, " << total_seconds << " s in steps\n";
+        for(const auto& volume : volumes) {
+            output << "  " << std::setw(20) << std::left << volume.first << std::right << std::setw(12) << volume.second.first
+                   << " steps " << std::setw(12) << volume.second.second << " s " << std::setw(6) << std::fixed
+                   << std::setprecision(1) << percent(volume.second.second) << "%" << std::defaultfloat
+                   << std::setprecision(6) << "\n";
+        }
+        for(std::size_t i = 0; i < std::min(max_entries, entries.size()); ++i) {
+            const auto& entry = entries[i];
+            output << "  " << std::setw(20) << std::left << entry.volume << std::setw(12) << entry.particle << std::setw(20)
+                   << entry.process << std::right << std::setw(12) << entry.steps << " steps " << std::setw(12)
+                   << entry.seconds << " s " << std::setw(6) << std::fixed << std::setprecision(1) << percent(entry.seconds)
+                   << "%" << std::defaultfloat << std::setprecision(6) << "\n";
+        }
+    }
+
+    /**
+     * @brief Clear the merged statistics
+     */
+    static void Reset() {
+        std::lock_guard<std::mutex> lock{merged_mutex()};
+        merged().clear();
+    }
+
+private:
+    struct Key {
+        const G4LogicalVolume* volume;
+        const G4ParticleDefinition* particle;
+        const G4VProcess* process;
+
+        bool operator==(const Key& other) const {
+            return volume == other.volume && particle == other.particle && process == other.process;
+        }
+    };
+
+    struct Slot {
+        Key key;
+        std::uint64_t steps;
+        std::uint64_t nanoseconds;
+        bool used;
+    };
+
+    static constexpr std::size_t initial_capacity = 256;
+
+    static std::size_t hash(const Key& key) {
+        auto h = reinterpret_cast<std::uintptr_t>(key.volume) * 0x9E3779B97F4A7C15ull;
+        h ^= reinterpret_cast<std::uintptr_t>(key.particle) * 0xC2B2AE3D27D4EB4Full;
+        h ^= reinterpret_cast<std::uintptr_t>(key.process) * 0x165667B19E3779F9ull;
+        return static_cast<std::size_t>(h ^ (h >> 29));
+    }
+
+    // Linear probing in a power of two table that is kept at most half full
+    Slot& find(const Key& key) {
+        std::size_t mask = slots_.size() - 1;
+        std::size_t index = hash(key) & mask;
+        while(slots_[index].used) {
+            if(slots_[index].key == key) {
+                return slots_[index];
+            }
+            index = (index + 1) & mask;
+        }
+
+        if(2 * (used_ + 1) > slots_.size()) {
+            grow();
+            return find(key);
+        }
+        slots_[index] = {key, 0, 0, true};
+        ++used_;
+        return slots_[index];
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2);
+        std::swap(old, slots_);
+        used_ = 0;
+        for(const auto& slot : old) {
+            if(slot.used) {
+                Slot& moved = find(slot.key);
+                moved.steps = slot.steps;
+                moved.nanoseconds = slot.nanoseconds;
+            }
+        }
+    }
+
+    static std::string volume_name(const G4LogicalVolume* volume) {
+        return volume != nullptr ? std::string(volume->GetName()) : "OutOfWorld";
+    }
+
+    using MergedTable = std::map<std::tuple<std::string, std::string, std::string>, std::pair<std::uint64_t, std::uint64_t>>;
+    static MergedTable& merged() {
+        static MergedTable table;
+        return table;
+    }
+    static std::mutex& merged_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    // CPU time consumed by the calling thread
+    static std::uint64_t thread_cpu_nanoseconds() {
+        timespec time{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return static_cast<std::uint64_t>(time.tv_sec) * 1000000000u + static_cast<std::uint64_t>(time.tv_nsec);
+    }
+
+    std::vector<Slot> slots_;
+    std::size_t used_{0};
+    std::uint64_t last_step_{thread_cpu_nanoseconds()};
+};
+
+/**
+ * @brief Restarts the step clock of the profiler for every track, so time between tracks and events is not counted
+ */
+class SteppingProfilerTrackingAction : public G4UserTrackingAction {
+public:
+    explicit SteppingProfilerTrackingAction(SteppingProfiler* profiler) : profiler_(profiler) {}
+
+    void PreUserTrackingAction(const G4Track*) override { profiler_->StartTrack(); }
+
+private:
+    SteppingProfiler* profiler_;
+};
@@ -1,16 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "hits.hpp"
+#include "pixelgrid.hpp"
+#include "tally.hpp"
+#include "../tools/SubEvent.hpp"
+
+#include <G4AffineTransform.hh>
+#include <G4NavigationHistory.hh>
 #include <G4VSensitiveDetector.hh>
 #include <G4SDManager.hh>
-#include <thread>
+#include <G4EventManager.hh>
+#include <G4Event.hh>
+#include <G4Step.hh>
 
 /**
  * @brief Handles the steps of the particles in all sensitive devices
+ *
+ * Every worker constructs its own instance, so the hit buffer is private to the thread. Hits are collected during the
+ * event and handed to the event callback at the end of the event.
+ *
+ * With a pixel grid the steps are digitized in place instead: the deposits are binned into the pixels of the sensor
+ * and every hit handed to the callback is a pixel with charge, placed at the pixel centre in the local frame of its
+ * plane (z = 0), with the earliest time and the first track of the pixel.
  */
 class SensitiveDetectorActionG4 : public G4VSensitiveDetector {
 public:
+    /**
+     * @brief Function receiving the hits of every finished event, called on the worker thread that simulated it
+     */
+    using EventCallback = std::function<void(G4int event_id, const HitBuffer& hits)>;
+
     /**
      * @brief Constructs the action handling for every sensitive detector
+     * @param plane_depth Depth in the touchable history of the volume whose copy number is the plane index
      */
-    SensitiveDetectorActionG4() : G4VSensitiveDetector("SensitiveDetector") {
+    explicit SensitiveDetectorActionG4(G4int plane_depth = 0)
+        : G4VSensitiveDetector("SensitiveDetector"), hits_(initial_capacity), plane_depth_(plane_depth) {
         // Add the sensor to the internal sensitive detector manager
         G4SDManager* sd_man_g4 = G4SDManager::GetSDMpointer();
         sd_man_g4->AddNewDetector(this);
@@ -18,6 +50,29 @@ public:
         std::cerr<< "SensitiveDetectorActionG4" << std::endl;
     };
 
+    /**
+     * @brief Set the callback receiving the hits of each event
+     * @param callback Function called at the end of every event, must be safe to call from several workers at once
+     *
+     * Must be set before the workers start processing events.
+     */
+    static void SetEventCallback(EventCallback callback) { event_callback() = std::move(callback); }
+
+    /**
+     * @brief Digitize the deposits into square pixels instead of storing every step
+     * @param half_x Half width of the sensor along its local x axis
+     * @param half_y Half width of the sensor along its local y axis
+     * @param pitch Size of a pixel, zero stores every step
+     */
+    void SetPixelGrid(double half_x, double half_y, double pitch) {
+        pixels_ = (pitch > 0 ? std::make_unique<PixelGrid>(half_x, half_y, pitch) : nullptr);
+    }
+
+    /**
+     * @brief Reset the hit buffer at the start of an event
+     */
+    void Initialize(G4HCofThisEvent*) override { hits_.clear(); };
+
     /**
      * @brief Process a single step of a particle passage through this sensor
      * @param step Information about the step
@@ -29,14 +84,128 @@ public:
         G4StepPoint* preStepPoint = step->GetPreStepPoint();
         G4StepPoint* postStepPoint = step->GetPostStepPoint();
 
-        // Get Transportaion Matrix
-        G4TouchableHandle theTouchable = step->GetPreStepPoint()->GetTouchableHandle();
+        if(pixels_) {
+            if(edep <= 0) {
+                return false;
+            }
+            stage(edep, preStepPoint, postStepPoint, step->GetTrack()->GetTrackID());
+            return true;
+        }
 
         // Put the charge deposit in the middle of the step
         G4ThreeVector mid_pos = (preStepPoint->GetPosition() + postStepPoint->GetPosition()) / 2;
         double mid_time = (preStepPoint->GetGlobalTime() + postStepPoint->GetGlobalTime()) / 2;
 
-        std::cerr << std::this_thread::get_id() <<  " Step. E=" << edep << " PosX=" << mid_pos.x() << " t=" << mid_time << std::endl;
+        G4int plane = preStepPoint->GetTouchableHandle()->GetCopyNumber(plane_depth_);
+        hits_.push_back(edep, mid_pos, mid_time, step->GetTrack()->GetTrackID(), preStepPoint->GetPhysicalVolume(), plane);
         return true;
     };
+
+    /**
+     * @brief Add the hits of the finished event to the run tally and hand them to the event callback
+     */
+    void EndOfEvent(G4HCofThisEvent*) override {
+        if(pixels_) {
+            digitize();
+            pixels_->read_out([this](G4int plane, double x, double y, double charge, double time, G4int track_id) {
+                hits_.push_back(charge, G4ThreeVector(x, y, 0), time, track_id, planes_[static_cast<std::size_t>(plane)].volume, plane);
+            });
+        }
+
+        // The sub-events of a logical event are separate Geant4 events, only the first slice counts the event
+        const SubEventSlice& slice = SubEventSlice::current();
+        RunTally::AddEvent(hits_, !slice.active || slice.index == 0);
+
+        const auto& callback = event_callback();
+        if(callback) {
+            callback(G4EventManager::GetEventManager()->GetConstCurrentEvent()->GetEventID(), hits_);
+        }
+    };
+
+private:
+    // Number of hits reserved per worker up front to avoid growing the buffer during the first events
+    static constexpr std::size_t initial_capacity = 4096;
+
+    // Number of steps whose midpoints are computed together
+    static constexpr std::size_t step_batch = 64;
+
+    // Sensor plane as seen by the first step in it, the planes do not move during the run
+    struct Plane {
+        bool known{false};
+        G4AffineTransform to_local;
+        const G4VPhysicalVolume* volume{nullptr};
+    };
+
+    // Steps waiting to be digitized, one array per quantity
+    struct StepBatch {
+        std::size_t size{0};
+        std::array<double, step_batch> pre_x, pre_y, pre_z, pre_time;
+        std::array<double, step_batch> post_x, post_y, post_z, post_time;
+        std::array<double, step_batch> edep;
+        std::array<G4int, step_batch> track_id, plane;
+    };
+
+    static EventCallback& event_callback() {
+        static EventCallback callback;
+        return callback;
+    }
+
+    // Queue a step for digitization, digitizing the queued steps once the batch is full
+    void stage(double edep, const G4StepPoint* pre, const G4StepPoint* post, G4int track_id) {
+        G4int plane = pre->GetTouchableHandle()->GetCopyNumber(plane_depth_);
+        auto index = static_cast<std::size_t>(plane);
+        if(index >= planes_.size()) {
+            planes_.resize(index + 1);
+        }
+        if(!planes_[index].known) {
+            planes_[index].known = true;
+            planes_[index].to_local = pre->GetTouchableHandle()->GetHistory()->GetTopTransform();
+            planes_[index].volume = pre->GetPhysicalVolume();
+        }
+
+        std::size_t i = batch_.size++;
+        const G4ThreeVector& pre_position = pre->GetPosition();
+        const G4ThreeVector& post_position = post->GetPosition();
+        batch_.pre_x[i] = pre_position.x();
+        batch_.pre_y[i] = pre_position.y();
+        batch_.pre_z[i] = pre_position.z();
+        batch_.pre_time[i] = pre->GetGlobalTime();
+        batch_.post_x[i] = post_position.x();
+        batch_.post_y[i] = post_position.y();
+        batch_.post_z[i] = post_position.z();
+        batch_.post_time[i] = post->GetGlobalTime();
+        batch_.edep[i] = edep;
+        batch_.track_id[i] = track_id;
+        batch_.plane[i] = plane;
+
+        if(batch_.size == step_batch) {
+            digitize();
+        }
+    }
+
+    // Put the deposits of all queued steps in the middle of their step and add them to the pixels
+    void digitize() {
+        std::size_t n = batch_.size;
+        // Independent iterations over contiguous arrays, the compiler vectorizes these
+        for(std::size_t i = 0; i < n; ++i) {
+            batch_.pre_x[i] = 0.5 * (batch_.pre_x[i] + batch_.post_x[i]);
+            batch_.pre_y[i] = 0.5 * (batch_.pre_y[i] + batch_.post_y[i]);
+            batch_.pre_z[i] = 0.5 * (batch_.pre_z[i] + batch_.post_z[i]);
+            batch_.pre_time[i] = 0.5 * (batch_.pre_time[i] + batch_.post_time[i]);
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            const Plane& plane = planes_[static_cast<std::size_t>(batch_.plane[i])];
+            G4ThreeVector local = plane.to_local.TransformPoint(G4ThreeVector(batch_.pre_x[i], batch_.pre_y[i], batch_.pre_z[i]));
+            pixels_->add(batch_.plane[i], local.x(), local.y(), batch_.edep[i], batch_.pre_time[i], batch_.track_id[i]);
+        }
+        batch_.size = 0;
+    }
+
+    HitBuffer hits_;
+    G4int plane_depth_;
+
+    // Only used when digitizing
+    std::unique_ptr<PixelGrid> pixels_;
+    std::vector<Plane> planes_;
+    StepBatch batch_;
 };
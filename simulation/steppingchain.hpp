@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <G4Step.hh>
+#include <G4UserSteppingAction.hh>
+
+/**
+ * @brief Runs several stepping actions on every step, since a worker only accepts a single one
+ *
+ * The chain owns the actions and calls them in the order they were added, so for instance the stepping profiler,
+ * the performance policy and the step counting of the benchmark can be used together.
+ */
+class SteppingActionChain : public G4UserSteppingAction {
+public:
+    /**
+     * @brief Append an action, the chain takes ownership
+     */
+    void Add(G4UserSteppingAction* action) { actions_.emplace_back(action); }
+
+    /**
+     * @brief Return true if no action has been added
+     */
+    bool Empty() const { return actions_.empty(); }
+
+    void SetSteppingManagerPointer(G4SteppingManager* manager) override {
+        G4UserSteppingAction::SetSteppingManagerPointer(manager);
+        for(auto& action : actions_) {
+            action->SetSteppingManagerPointer(manager);
+        }
+    }
+
+    void UserSteppingAction(const G4Step* step) override {
+        for(auto& action : actions_) {
+            action->UserSteppingAction(step);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<G4UserSteppingAction>> actions_;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <G4Step.hh>
+#include <G4UserSteppingAction.hh>
+
+#include "hits.hpp"
+
+/**
+ * @brief Run-level totals of a single thread or merged from all threads
+ *
+ * The energy deposit histogram has bins_per_decade logarithmic bins per decade between min_edep and max_edep, plus an
+ * underflow bin in front and an overflow bin at the end.
+ */
+struct RunSummary {
+    static constexpr std::size_t bins_per_decade = 10;
+    static constexpr std::size_t decades = 8;
+    static constexpr std::size_t n_bins = bins_per_decade * decades + 2;
+    // Deposits are in MeV, the histogram covers 1 eV to 100 MeV
+    static constexpr double min_edep = 1e-6;
+    static constexpr double max_edep = 1e2;
+
+    std::uint64_t events{0};
+    std::uint64_t runs{0};
+    std::uint64_t hits{0};
+    std::uint64_t steps{0};
+    double edep{0};
+    std::array<std::uint64_t, n_bins> edep_histogram{};
+
+    /**
+     * @brief Return the histogram bin of an energy deposit
+     */
+    static std::size_t bin(double edep) {
+        if(!(edep >= min_edep)) {
+            return 0;
+        }
+        auto index = static_cast<std::size_t>(std::log10(edep / min_edep) * bins_per_decade);
+        return index < n_bins - 2 ? index + 1 : n_bins - 1;
+    }
+
+    /**
+     * @brief Return the lower edge of a histogram bin, zero for the underflow bin
+     */
+    static double bin_low(std::size_t bin) {
+        return bin == 0 ? 0. : min_edep * std::pow(10., static_cast<double>(bin - 1) / bins_per_decade);
+    }
+
+    /**
+     * @brief Add the totals of another summary to this one
+     */
+    RunSummary& operator+=(const RunSummary& other) {
+        events += other.events;
+        runs += other.runs;
+        hits += other.hits;
+        steps += other.steps;
+        edep += other.edep;
+        for(std::size_t i = 0; i < n_bins; ++i) {
+            edep_histogram[i] += other.edep_histogram[i];
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Print the totals and the non-empty histogram bins
+     */
+    void print(std::ostream& output) const {
+        output << "Run summary: " << events << " event(s) in " << runs << " run(s), " << hits << " hit(s) with " << edep
+               << " MeV, " << steps << " step(s)\n";
+        for(std::size_t i = 0; i < n_bins; ++i) {
+            if(edep_histogram[i] > 0) {
+                output << "  edep >= " << bin_low(i) << " MeV: " << edep_histogram[i] << "\n";
+            }
+        }
+    }
+};
+
+/**
+ * @brief Run-level accumulators of every thread, merged on demand without synchronizing the threads filling them
+ *
+ * Every thread claims its own slot the first time it adds something. Slots are padded by a cache line, so threads never
+ * write to the same cache line. Only the owning thread writes a slot: its counters are atomics updated with a relaxed
+ * load and store instead of a locked read-modify-write, which costs the same as a plain addition but lets the master
+ * read the slots at any time. A thread releases its slot when it exits and the next thread claiming a slot takes it
+ * over and keeps adding to it, so the totals of terminated workers are kept until Reset and the number of slots stays
+ * at the largest number of threads alive at once however often the pool replaces its threads.
+ *
+ * Merge reads all slots and sums them pairwise in a tree, the order of the floating point sums only depends on the
+ * number of slots.
+ */
+class RunTally {
+public:
+    /**
+     * @brief Count a finished event and the hits it produced
+     * @param hits Hits of the event
+     * @param new_event False to only add the hits, for the further sub-events of a logical event counted already
+     */
+    static void AddEvent(const HitBuffer& hits, bool new_event = true) {
+        Slot& slot = local();
+        if(new_event) {
+            add(slot.events, 1);
+        }
+        add(slot.hits, hits.size());
+        double edep = 0;
+        for(double hit_edep : hits.edep()) {
+            add(slot.edep_histogram[RunSummary::bin(hit_edep)], 1);
+            edep += hit_edep;
+        }
+        slot.edep.store(slot.edep.load(std::memory_order_relaxed) + edep, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Count a finished run of the calling thread's worker
+     */
+    static void AddRun() { add(local().runs, 1); }
+
+    /**
+     * @brief Count a step, called from RunTallySteppingAction
+     */
+    static void AddStep() { add(local().steps, 1); }
+
+    /**
+     * @brief Merge the totals of all threads, can be called while the threads keep filling their slots
+     */
+    static RunSummary Merge() {
+        std::vector<RunSummary> partial;
+        {
+            std::lock_guard<std::mutex> lock{slots_mutex()};
+            partial.reserve(slots().size());
+            for(const Slot& slot : slots()) {
+                partial.push_back(slot.read());
+            }
+        }
+        if(partial.empty()) {
+            return {};
+        }
+
+        // Pairwise reduction, after the pass with the given stride every multiple of twice the stride holds the sum
+        // of its subtree
+        for(std::size_t stride = 1; stride < partial.size(); stride *= 2) {
+            for(std::size_t i = 0; i + stride < partial.size(); i += 2 * stride) {
+                partial[i] += partial[i + stride];
+            }
+        }
+        return partial.front();
+    }
+
+    /**
+     * @brief Clear the totals of all threads, must only be called while no thread fills its slot
+     */
+    static void Reset() {
+        std::lock_guard<std::mutex> lock{slots_mutex()};
+        for(Slot& slot : slots()) {
+            slot.clear();
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::uint64_t> events{0};
+        std::atomic<std::uint64_t> runs{0};
+        std::atomic<std::uint64_t> hits{0};
+        std::atomic<std::uint64_t> steps{0};
+        std::atomic<double> edep{0};
+        std::array<std::atomic<std::uint64_t>, RunSummary::n_bins> edep_histogram{};
+        // Keeps the counters of the next slot off the last cache line of this one, without requiring an over-aligned
+        // allocation from the deque
+        char padding[64];
+
+        RunSummary read() const {
+            RunSummary summary;
+            summary.events = events.load(std::memory_order_relaxed);
+            summary.runs = runs.load(std::memory_order_relaxed);
+            summary.hits = hits.load(std::memory_order_relaxed);
+            summary.steps = steps.load(std::memory_order_relaxed);
+            summary.edep = edep.load(std::memory_order_relaxed);
+            for(std::size_t i = 0; i < RunSummary::n_bins; ++i) {
+                summary.edep_histogram[i] = edep_histogram[i].load(std::memory_order_relaxed);
+            }
+            return summary;
+        }
+
+        void clear() {
+            for(auto* counter : {&events, &runs, &hits, &steps}) {
+                counter->store(0, std::memory_order_relaxed);
+            }
+            edep.store(0, std::memory_order_relaxed);
+            for(auto& bin : edep_histogram) {
+                bin.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    // Only the owning thread writes a slot, so the addition does not need to be atomic as a whole
+    static void add(std::atomic<std::uint64_t>& counter, std::uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // Slot of a thread, released by the thread-local destructor when the thread exits
+    struct Claim {
+        Slot* slot;
+
+        Claim() {
+            std::lock_guard<std::mutex> lock{slots_mutex()};
+            if(released().empty()) {
+                slots().emplace_back();
+                slot = &slots().back();
+            } else {
+                // The lock orders the updates of the previous owner before the ones of this thread
+                slot = released().back();
+                released().pop_back();
+            }
+        }
+        ~Claim() {
+            std::lock_guard<std::mutex> lock{slots_mutex()};
+            released().push_back(slot);
+        }
+    };
+
+    // Return the slot of the calling thread, claimed on its first use
+    static Slot& local() {
+        static thread_local Claim claim;
+        return *claim.slot;
+    }
+
+    static std::mutex& slots_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+    // A deque never moves its elements when growing at the end
+    static std::deque<Slot>& slots() {
+        static std::deque<Slot> all;
+        return all;
+    }
+    // Slots of exited threads, waiting for the next thread
+    static std::vector<Slot*>& released() {
+        static std::vector<Slot*> slots_of_exited;
+        return slots_of_exited;
+    }
+};
+
+/**
+ * @brief Counts the steps of the worker in its RunTally slot
+ */
+class RunTallySteppingAction : public G4UserSteppingAction {
+public:
+    void UserSteppingAction(const G4Step*) override { RunTally::AddStep(); }
+};
@@ -0,0 +1,54 @@
+#ifndef BATCHGAUSSIAN_H
+#define BATCHGAUSSIAN_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Samples blocks of uniform and Gaussian numbers from counter-based keys
+ *
+ * All functions work on plain arrays with independent iterations and no branches, so the compiler can vectorize the
+ * loops. Every output only depends on its own input, sampling a value in a block or on its own gives bit-identical
+ * results.
+ */
+class BatchGaussian {
+public:
+    /**
+     * @brief Convert random bits to a double in the open interval (0, 1)
+     * @param bits Random bits, only the upper 53 bits are used
+     */
+    static double to_unit(std::uint64_t bits) { return (static_cast<double>(bits >> 11) + 0.5) * (1. / 9007199254740992.); }
+
+    /**
+     * @brief Convert arrays of random bits to doubles in (0, 1)
+     * @param bits Random bits
+     * @param out Output array
+     * @param n Number of values
+     */
+    static void to_unit(const std::uint64_t* bits, double* out, std::size_t n) {
+        for(std::size_t i = 0; i < n; ++i) {
+            out[i] = to_unit(bits[i]);
+        }
+    }
+
+    /**
+     * @brief Box-Muller transform of pairs of uniform numbers into pairs of independent standard normal numbers
+     * @param u1 First uniform number of every pair, in (0, 1)
+     * @param u2 Second uniform number of every pair, in (0, 1)
+     * @param z1 First normal number of every pair
+     * @param z2 Second normal number of every pair
+     * @param n Number of pairs
+     */
+    static void box_muller(const double* u1, const double* u2, double* z1, double* z2, std::size_t n) {
+        constexpr double two_pi = 6.283185307179586476925286766559;
+        for(std::size_t i = 0; i < n; ++i) {
+            double radius = std::sqrt(-2. * std::log(u1[i]));
+            double angle = two_pi * u2[i];
+            z1[i] = radius * std::cos(angle);
+            z2[i] = radius * std::sin(angle);
+        }
+    }
+};
+
+#endif
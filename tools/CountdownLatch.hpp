@@ -0,0 +1,68 @@
+#ifndef COUNTDOWNLATCH_H
+#define COUNTDOWNLATCH_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/**
+ * @brief Single-use barrier that releases waiting threads once it has been counted down to zero
+ *
+ * The count is only changed while holding the mutex, so a waiter cannot observe zero and destroy the latch while the
+ * thread counting it down still uses the mutex or the condition variable.
+ */
+class CountdownLatch {
+public:
+    /**
+     * @brief Constructs the latch
+     * @param count Number of count downs needed to release the waiting threads
+     */
+    explicit CountdownLatch(std::size_t count) : count_(count) {}
+
+    CountdownLatch(const CountdownLatch&) = delete;
+    CountdownLatch& operator=(const CountdownLatch&) = delete;
+
+    /**
+     * @brief Increase the number of expected count downs, must be called before the latch reached zero
+     * @param n Number of count downs to add
+     */
+    void add(std::size_t n = 1) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        count_ += n;
+    }
+
+    /**
+     * @brief Count the latch down and release the waiting threads when it reaches zero
+     * @param n Number of count downs
+     */
+    void count_down(std::size_t n = 1) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        count_ -= n;
+        if(count_ == 0) {
+            condition_.notify_all();
+        }
+    }
+
+    /**
+     * @brief Return if the latch has reached zero
+     */
+    bool try_wait() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return count_ == 0;
+    }
+
+    /**
+     * @brief Block until the latch has reached zero
+     */
+    void wait() const {
+        std::unique_lock<std::mutex> lock{mutex_};
+        condition_.wait(lock, [this]() { return count_ == 0; });
+    }
+
+private:
+    std::size_t count_;
+    mutable std::mutex mutex_;
+    mutable std::condition_variable condition_;
+};
+
+#endif
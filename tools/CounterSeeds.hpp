@@ -0,0 +1,66 @@
+#ifndef COUNTERSEEDS_H
+#define COUNTERSEEDS_H
+
+#include <cstdint>
+
+/**
+ * @brief Counter-based seed generator
+ *
+ * Every seed is a pure function of the master seed, the event number, the index of the seed within the event and an
+ * optional stream number. No state is shared or advanced, so any thread can derive the seeds of any event without
+ * synchronization and the result does not depend on the order in which events are handed out.
+ */
+class CounterSeeds {
+public:
+    /**
+     * @brief Constructs the generator
+     * @param master_seed Seed from which all event seeds are derived
+     */
+    explicit CounterSeeds(std::uint64_t master_seed = 0) : master_seed_(master_seed) {}
+
+    /**
+     * @brief Return the master seed all event seeds are derived from
+     */
+    std::uint64_t master_seed() const { return master_seed_; }
+
+    /**
+     * @brief Derive a 64 bit key for an event
+     * @param event Event number
+     * @param index Index of the key within the event
+     * @param stream Independent stream the key is drawn from, the default stream seeds the event itself
+     * @return Key that is statistically independent for every distinct set of arguments
+     */
+    std::uint64_t key(std::int64_t event, std::uint32_t index, std::uint32_t stream = 0) const {
+        std::uint64_t counter = mix(master_seed_ ^ mix(static_cast<std::uint64_t>(event)));
+        counter ^= (static_cast<std::uint64_t>(stream) << 32) | index;
+        return mix(counter);
+    }
+
+    /**
+     * @brief Derive a seed for the random number engine of an event
+     * @param event Event number
+     * @param index Index of the seed within the event
+     * @param stream Independent stream the seed is drawn from, the default stream seeds the event itself
+     * @return Seed in the range [1, 2^31 - 1) accepted by all CLHEP engines
+     */
+    long seed(std::int64_t event, std::uint32_t index, std::uint32_t stream = 0) const {
+        return 1 + static_cast<long>(key(event, index, stream) % 2147483646u);
+    }
+
+    /**
+     * @brief Bijective 64 bit mixing function (SplitMix64 finalizer)
+     * @param value Value to mix
+     * @return Mixed value
+     */
+    static std::uint64_t mix(std::uint64_t value) {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+private:
+    std::uint64_t master_seed_;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * @brief Layout of the CPUs available to this process over cores, sockets and NUMA nodes
+ *
+ * The layout is read from sysfs on Linux. On other systems, or if sysfs is not readable, all CPUs reported by the
+ * standard library are assumed to be on a single node and pinning is not supported.
+ */
+class CpuTopology {
+public:
+    /**
+     * @brief Location of a single logical CPU
+     */
+    struct Cpu {
+        int id;
+        int core;
+        int package;
+        int node;
+    };
+
+    /**
+     * @brief Detect the CPUs this process is allowed to run on
+     */
+    static CpuTopology detect() {
+        CpuTopology topology;
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool have_mask = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+        for(int id : parse_list(read_line("/sys/devices/system/cpu/online"))) {
+            if(have_mask && !CPU_ISSET(static_cast<std::size_t>(id), &allowed)) {
+                continue;
+            }
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+            topology.cpus_.push_back({id, read_int(base + "core_id", id), read_int(base + "physical_package_id", 0), 0});
+        }
+
+        for(int node : parse_list(read_line("/sys/devices/system/node/online"))) {
+            for(int id : parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))) {
+                for(auto& cpu : topology.cpus_) {
+                    if(cpu.id == id) {
+                        cpu.node = node;
+                    }
+                }
+            }
+        }
+#endif
+        if(topology.cpus_.empty()) {
+            int n_cpus = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+            for(int id = 0; id < n_cpus; ++id) {
+                topology.cpus_.push_back({id, id, 0, 0});
+            }
+        }
+        return topology;
+    }
+
+    /**
+     * @brief Return all available CPUs
+     */
+    const std::vector<Cpu>& cpus() const { return cpus_; }
+
+    /**
+     * @brief Return the NUMA node of a CPU or -1 if the CPU is unknown
+     * @param id Identifier of the CPU
+     */
+    int node_of(int id) const {
+        for(const auto& cpu : cpus_) {
+            if(cpu.id == id) {
+                return cpu.node;
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief CPUs ordered to keep consecutive threads close together
+     *
+     * Fills one node and socket before moving to the next, hyperthreads of the same core are adjacent.
+     */
+    std::vector<int> compact_order() const {
+        std::vector<Cpu> sorted = cpus_;
+        std::sort(sorted.begin(), sorted.end(), [](const Cpu& a, const Cpu& b) {
+            return std::tie(a.node, a.package, a.core, a.id) < std::tie(b.node, b.package, b.core, b.id);
+        });
+        std::vector<int> order;
+        for(const auto& cpu : sorted) {
+            order.push_back(cpu.id);
+        }
+        return order;
+    }
+
+    /**
+     * @brief CPUs ordered to spread consecutive threads over the nodes
+     *
+     * Alternates between the nodes and uses one hyperthread of every core before the second one.
+     */
+    std::vector<int> scatter_order() const {
+        std::vector<Cpu> sorted = cpus_;
+        // Rank of every CPU among the hyperthreads of its core
+        std::vector<int> smt_rank(sorted.size(), 0);
+        for(std::size_t i = 0; i < sorted.size(); ++i) {
+            for(std::size_t j = 0; j < sorted.size(); ++j) {
+                if(sorted[j].package == sorted[i].package && sorted[j].core == sorted[i].core && sorted[j].id < sorted[i].id) {
+                    ++smt_rank[i];
+                }
+            }
+        }
+
+        // Order within every node by hyperthread rank first, then deal the nodes out round-robin
+        std::vector<std::vector<int>> per_node;
+        std::vector<int> nodes;
+        std::vector<std::size_t> index(sorted.size());
+        for(std::size_t i = 0; i < index.size(); ++i) {
+            index[i] = i;
+        }
+        std::sort(index.begin(), index.end(), [&](std::size_t a, std::size_t b) {
+            return std::tie(sorted[a].node, smt_rank[a], sorted[a].package, sorted[a].core, sorted[a].id) <
+                   std::tie(sorted[b].node, smt_rank[b], sorted[b].package, sorted[b].core, sorted[b].id);
+        });
+        for(std::size_t i : index) {
+            if(nodes.empty() || nodes.back() != sorted[i].node) {
+                nodes.push_back(sorted[i].node);
+                per_node.emplace_back();
+            }
+            per_node.back().push_back(sorted[i].id);
+        }
+
+        std::vector<int> order;
+        for(std::size_t round = 0; order.size() < sorted.size(); ++round) {
+            for(const auto& node_cpus : per_node) {
+                if(round < node_cpus.size()) {
+                    order.push_back(node_cpus[round]);
+                }
+            }
+        }
+        return order;
+    }
+
+    /**
+     * @brief Pin the calling thread to a single CPU
+     * @param id Identifier of the CPU
+     * @return True if the thread was pinned, false if pinning failed or is not supported
+     */
+    static bool pin_current_thread(int id) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<std::size_t>(id), &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        (void)id;
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Return the CPU the calling thread is currently running on or -1 if unknown
+     */
+    static int current_cpu() {
+#ifdef __linux__
+        return sched_getcpu();
+#else
+        return -1;
+#endif
+    }
+
+    /**
+     * @brief Parse a CPU list in the sysfs format, such as "0-3,8,10-11"
+     * @param list CPU list to parse
+     * @return Identifiers of all listed CPUs
+     * @throws std::invalid_argument if the list is malformed or a range is reversed
+     */
+    static std::vector<int> parse_list(const std::string& list) {
+        std::vector<int> ids;
+        std::stringstream stream(list);
+        std::string range;
+        while(std::getline(stream, range, ',')) {
+            if(range.empty()) {
+                continue;
+            }
+            auto dash = range.find('-');
+            int first = parse_id(range.substr(0, dash), list);
+            int last = (dash == std::string::npos ? first : parse_id(range.substr(dash + 1), list));
+            if(last < first) {
+                throw std::invalid_argument("invalid CPU list " + list + ", range " + range + " is reversed");
+            }
+            for(int id = first; id <= last; ++id) {
+                ids.push_back(id);
+            }
+        }
+        return ids;
+    }
+
+private:
+    // Parse a single CPU id of a list, only digits are accepted
+    static int parse_id(const std::string& id, const std::string& list) {
+        if(id.empty() || id.size() > 6 || id.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::invalid_argument("invalid CPU list " + list + ", expected CPU ids and ranges such as 0-3,8");
+        }
+        return std::stoi(id);
+    }
+
+    static std::string read_line(const std::string& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    static int read_int(const std::string& path, int fallback) {
+        std::string line = read_line(path);
+        return line.empty() ? fallback : std::stoi(line);
+    }
+
+    std::vector<Cpu> cpus_;
+};
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Low-overhead per-thread timers and counters for the hot paths of the run managers and the thread pool
+ *
+ * Every thread owns a cache-line aligned slot of counters that only it writes to, readers aggregate all slots without
+ * locking while the threads keep running. The INSTRUMENT_* macros expand to nothing unless G4MT_INSTRUMENTATION is
+ * defined, so instrumented code has no cost when instrumentation is compiled out.
+ */
+namespace instrumentation {
+    /**
+     * @brief Instrumented code sections
+     */
+    enum class Timer : std::size_t {
+        QueueWait,         ///< Pool thread parked waiting for a task
+        TaskExecution,     ///< Pool thread executing a task
+        SeedDispensing,    ///< Master reserving seeds in SimpleMasterRunManager::Run
+        RunPreparation,    ///< Worker updating from the master and applying new UI commands before a run
+        RunInitialization, ///< Worker initializing a run
+        GenerateEvent,     ///< Worker seeding and generating the primaries of an event
+        ProcessOneEvent,   ///< Worker simulating an event, including its generation
+        TerminateOneEvent, ///< Worker finishing an event
+        RunTermination,    ///< Worker closing a run
+        Count
+    };
+
+    /**
+     * @brief Return the name of a timer
+     */
+    inline const char* timer_name(Timer timer) {
+        static const char* names[] = {"queue wait",         "task execution", "seed dispensing", "run preparation",
+                                      "run initialization", "generate event", "process event",   "terminate event",
+                                      "run termination"};
+        return names[static_cast<std::size_t>(timer)];
+    }
+
+    /**
+     * @brief Return if the instrumentation macros are compiled in
+     */
+    constexpr bool enabled() {
+#ifdef G4MT_INSTRUMENTATION
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    constexpr std::size_t n_timers = static_cast<std::size_t>(Timer::Count);
+
+    /**
+     * @brief Return the current time of the steady clock in nanoseconds
+     */
+    inline std::int64_t now_nanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief Counters of a single thread, only written by the owning thread
+     *
+     * The start of the running task is published as well, so readers can count the part of a long task that has
+     * already been executed instead of seeing all of its time at once when it finishes.
+     */
+    struct alignas(64) ThreadCounters {
+        std::array<std::atomic<std::uint64_t>, n_timers> calls{};
+        std::array<std::atomic<std::uint64_t>, n_timers> nanoseconds{};
+        std::atomic<std::uint64_t> events{0};
+        // Steady clock time in nanoseconds the running task started at, zero while no task runs
+        std::atomic<std::int64_t> task_start{0};
+
+        void add(Timer timer, std::uint64_t ns) {
+            auto index = static_cast<std::size_t>(timer);
+            calls[index].fetch_add(1, std::memory_order_relaxed);
+            // Released after clearing task_start, a reader seeing the time of a finished task no longer sees it running
+            nanoseconds[index].fetch_add(ns, std::memory_order_release);
+        }
+    };
+
+    /**
+     * @brief Fixed set of thread slots, threads claim a slot on their first measurement and release it when they exit
+     *
+     * A released slot is handed to the next thread claiming one with its counters kept, so the totals of exited threads
+     * are not lost and a pool replacing its threads over and over never runs out of slots.
+     */
+    class Registry {
+    public:
+        static constexpr std::size_t max_threads = 256;
+
+        /**
+         * @brief Return the counters of the calling thread
+         *
+         * Threads beyond the maximum alive at once share the last slot, which stays correct since all updates are atomic.
+         */
+        static ThreadCounters& local() {
+            static thread_local Claim claim;
+            return slots()[claim.index];
+        }
+
+        /**
+         * @brief Return the number of slots claimed so far
+         */
+        static std::size_t size() { return used().load(std::memory_order_relaxed); }
+
+        /**
+         * @brief Return the slot with the given index
+         */
+        static const ThreadCounters& slot(std::size_t index) { return slots()[index]; }
+
+    private:
+        // Slot of a thread, released by the thread-local destructor when the thread exits
+        struct Claim {
+            std::size_t index;
+            bool shared{false};
+
+            Claim() {
+                std::lock_guard<std::mutex> lock{mutex()};
+                if(!released().empty()) {
+                    // The lowest released slot, so the slots of the running threads stay at the front
+                    auto lowest = std::min_element(released().begin(), released().end());
+                    index = *lowest;
+                    released().erase(lowest);
+                } else if(used().load(std::memory_order_relaxed) < max_threads) {
+                    index = used().load(std::memory_order_relaxed);
+                    used().store(index + 1, std::memory_order_relaxed);
+                } else {
+                    index = max_threads - 1;
+                    shared = true;
+                }
+            }
+            ~Claim() {
+                if(!shared) {
+                    std::lock_guard<std::mutex> lock{mutex()};
+                    released().push_back(index);
+                }
+            }
+        };
+
+        static std::array<ThreadCounters, max_threads>& slots() {
+            static std::array<ThreadCounters, max_threads> counters;
+            return counters;
+        }
+        static std::atomic<std::size_t>& used() {
+            static std::atomic<std::size_t> n_used{0};
+            return n_used;
+        }
+        static std::vector<std::size_t>& released() {
+            static std::vector<std::size_t> indices;
+            return indices;
+        }
+        static std::mutex& mutex() {
+            static std::mutex claims_mutex;
+            return claims_mutex;
+        }
+    };
+
+    /**
+     * @brief Adds the lifetime of the object to a timer of the calling thread, task executions are published while running
+     */
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Timer timer) : timer_(timer), start_(now_nanoseconds()) {
+            if(timer_ == Timer::TaskExecution) {
+                Registry::local().task_start.store(start_, std::memory_order_relaxed);
+            }
+        }
+        ~ScopedTimer() {
+            ThreadCounters& counters = Registry::local();
+            if(timer_ == Timer::TaskExecution) {
+                counters.task_start.store(0, std::memory_order_relaxed);
+            }
+            counters.add(timer_, static_cast<std::uint64_t>(now_nanoseconds() - start_));
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Timer timer_;
+        std::int64_t start_;
+    };
+
+    /**
+     * @brief Snapshot of the counters of all threads
+     */
+    struct Snapshot {
+        struct Thread {
+            std::array<std::uint64_t, n_timers> calls;
+            std::array<std::uint64_t, n_timers> nanoseconds;
+            std::uint64_t events;
+            // Time the task running at the snapshot has executed so far, not yet part of the task execution timer
+            std::uint64_t running_task_ns;
+
+            /**
+             * @brief Return the time spent executing tasks, including the part of the running task
+             */
+            std::uint64_t task_ns() const {
+                return nanoseconds[static_cast<std::size_t>(Timer::TaskExecution)] + running_task_ns;
+            }
+        };
+        std::vector<Thread> threads;
+        std::chrono::steady_clock::time_point time;
+
+        /**
+         * @brief Read all slots, can be called while the threads are running
+         */
+        static Snapshot take() {
+            Snapshot snapshot;
+            snapshot.time = std::chrono::steady_clock::now();
+            std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(snapshot.time.time_since_epoch()).count();
+            for(std::size_t i = 0; i < Registry::size(); ++i) {
+                const ThreadCounters& counters = Registry::slot(i);
+                Thread thread{};
+                for(std::size_t t = 0; t < n_timers; ++t) {
+                    thread.calls[t] = counters.calls[t].load(std::memory_order_relaxed);
+                    thread.nanoseconds[t] = counters.nanoseconds[t].load(std::memory_order_acquire);
+                }
+                // Read after the timers: a task whose time was already added is not counted as running again
+                std::int64_t task_start = counters.task_start.load(std::memory_order_relaxed);
+                thread.running_task_ns = (task_start != 0 && now > task_start ? static_cast<std::uint64_t>(now - task_start) : 0);
+                thread.events = counters.events.load(std::memory_order_relaxed);
+                snapshot.threads.push_back(thread);
+            }
+            return snapshot;
+        }
+
+        std::uint64_t total_events() const {
+            std::uint64_t events = 0;
+            for(const auto& thread : threads) {
+                events += thread.events;
+            }
+            return events;
+        }
+    };
+
+    /**
+     * @brief Background thread printing throughput, queue depth and thread utilization at a fixed interval
+     */
+    class PeriodicReporter {
+    public:
+        /**
+         * @brief Starts the reporter
+         * @param output Stream the reports are written to
+         * @param interval Time between two reports
+         * @param queue_depth Optional function returning the number of queued tasks
+         */
+        PeriodicReporter(std::ostream& output, std::chrono::milliseconds interval, std::function<std::size_t()> queue_depth = nullptr)
+            : output_(output), interval_(interval), queue_depth_(std::move(queue_depth)), start_(Snapshot::take()),
+              thread_([this]() { run(); }) {}
+
+        PeriodicReporter(const PeriodicReporter&) = delete;
+        PeriodicReporter& operator=(const PeriodicReporter&) = delete;
+
+        /**
+         * @brief Stops the reporter and prints the summary since its start
+         */
+        ~PeriodicReporter() {
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                stop_ = true;
+            }
+            condition_.notify_all();
+            thread_.join();
+            print_summary(output_, start_, Snapshot::take());
+        }
+
+        /**
+         * @brief Print the totals of every timer and the utilization of every thread between two snapshots
+         */
+        static void print_summary(std::ostream& output, const Snapshot& begin, const Snapshot& end) {
+            double seconds = std::chrono::duration<double>(end.time - begin.time).count();
+            output << "Instrumentation summary over " << seconds << " s"
+                   << (enabled() ? "" : " (instrumentation compiled out)") << "\n";
+            output << "  events: " << end.total_events() - begin.total_events() << "\n";
+            for(std::size_t t = 0; t < n_timers; ++t) {
+                std::uint64_t calls = 0, ns = 0;
+                for(std::size_t i = 0; i < end.threads.size(); ++i) {
+                    calls += end.threads[i].calls[t] - (i < begin.threads.size() ? begin.threads[i].calls[t] : 0);
+                    ns += end.threads[i].nanoseconds[t] - (i < begin.threads.size() ? begin.threads[i].nanoseconds[t] : 0);
+                }
+                output << "  " << std::setw(18) << std::left << timer_name(static_cast<Timer>(t)) << std::right << " calls "
+                       << std::setw(10) << calls << " total " << std::setw(10) << static_cast<double>(ns) * 1e-9 << " s mean "
+                       << (calls > 0 ? static_cast<double>(ns) / static_cast<double>(calls) * 1e-3 : 0.) << " us\n";
+            }
+            print_utilization(output, begin, end);
+        }
+
+    private:
+        // Fraction of the interval every thread spent executing tasks, including the tasks still running at either end.
+        // A task finishing while a snapshot is taken can be missed by it and counted in the next interval, so the
+        // fraction is clamped to 100%.
+        static void print_utilization(std::ostream& output, const Snapshot& begin, const Snapshot& end) {
+            double ns = std::chrono::duration<double, std::nano>(end.time - begin.time).count();
+            output << "  utilization:";
+            for(std::size_t i = 0; i < end.threads.size(); ++i) {
+                double task_ns = static_cast<double>(end.threads[i].task_ns()) -
+                                 (i < begin.threads.size() ? static_cast<double>(begin.threads[i].task_ns()) : 0.);
+                double fraction = (ns > 0 ? std::min(std::max(task_ns / ns, 0.), 1.) : 0.);
+                output << " " << std::fixed << std::setprecision(0) << 100. * fraction << "%";
+            }
+            output << std::defaultfloat << std::setprecision(6) << "\n";
+        }
+
+        void run() {
+            Snapshot last = start_;
+            std::unique_lock<std::mutex> lock{mutex_};
+            while(!condition_.wait_for(lock, interval_, [this]() { return stop_; })) {
+                Snapshot now = Snapshot::take();
+                double seconds = std::chrono::duration<double>(now.time - last.time).count();
+                output_ << "[instrumentation] " << static_cast<double>(now.total_events() - last.total_events()) / seconds
+                        << " events/s";
+                if(queue_depth_) {
+                    output_ << ", queue depth " << queue_depth_();
+                }
+                output_ << "\n";
+                print_utilization(output_, last, now);
+                output_ << std::flush;
+                last = now;
+            }
+        }
+
+        std::ostream& output_;
+        std::chrono::milliseconds interval_;
+        std::function<std::size_t()> queue_depth_;
+        Snapshot start_;
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        bool stop_{false};
+        std::thread thread_;
+    };
+} // namespace instrumentation
+
+#define INSTRUMENT_CONCAT_IMPL(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b) INSTRUMENT_CONCAT_IMPL(a, b)
+
+#ifdef G4MT_INSTRUMENTATION
+#define INSTRUMENT_SCOPE(timer) \
+    instrumentation::ScopedTimer INSTRUMENT_CONCAT(instrument_scope_, __LINE__)(instrumentation::Timer::timer)
+#define INSTRUMENT_EVENT() instrumentation::Registry::local().events.fetch_add(1, std::memory_order_relaxed)
+#else
+#define INSTRUMENT_SCOPE(timer)
+#define INSTRUMENT_EVENT()
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef ORDEREDSINK_H
+#define ORDEREDSINK_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Restores the order of results that complete out of order, using a bounded reorder window
+ *
+ * Every result is tagged with a sequence number. Results are buffered until all results with lower sequence numbers
+ * have arrived and are then handed to the consumer strictly in sequence. At most window results can be outstanding
+ * beyond the next expected one: producers call acquire() before they start the work for a sequence number and are
+ * throttled while it lies outside the window, so the buffer never grows beyond the window.
+ */
+template <typename T> class OrderedSink {
+public:
+    /**
+     * @brief Function receiving the results in sequence, never called concurrently
+     */
+    using Consumer = std::function<void(std::int64_t sequence, T&& value)>;
+
+    /**
+     * @brief Occupancy of the reorder buffer and throttling of the producers
+     */
+    struct Statistics {
+        std::size_t max_occupancy;
+        double mean_occupancy;
+        std::uint64_t throttled;
+        double throttled_seconds;
+    };
+
+    /**
+     * @brief Constructs the sink
+     * @param first Sequence number of the first result
+     * @param window Maximum number of sequence numbers that can be acquired beyond the next one to be released
+     * @param consumer Function receiving the results in sequence
+     */
+    OrderedSink(std::int64_t first, std::size_t window, Consumer consumer)
+        : first_(first), next_(first), window_(std::max<std::size_t>(window, 1)), consumer_(std::move(consumer)), values_(window_),
+          filled_(window_, false) {}
+
+    OrderedSink(const OrderedSink&) = delete;
+    OrderedSink& operator=(const OrderedSink&) = delete;
+
+    /**
+     * @brief Block until the result with the given sequence number fits into the reorder window
+     * @param sequence Sequence number the caller is about to produce
+     *
+     * The result of every sequence number below it has to be produced eventually, otherwise this blocks forever.
+     */
+    void acquire(std::int64_t sequence) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        if(fits(sequence)) {
+            return;
+        }
+        ++throttled_;
+        auto start = std::chrono::steady_clock::now();
+        space_.wait(lock, [this, sequence]() { return fits(sequence); });
+        throttled_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief Add the result of an acquired sequence number
+     * @param sequence Sequence number of the result, must have been passed to acquire() before
+     * @param value Result passed to the consumer once all earlier results have been released
+     *
+     * If the result completes the sequence, the calling thread hands all consecutive buffered results to the consumer
+     * unless another thread is already doing so.
+     */
+    void push(std::int64_t sequence, T value) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        std::size_t slot = index(sequence);
+        values_[slot] = std::move(value);
+        filled_[slot] = true;
+        ++occupancy_;
+        max_occupancy_ = std::max(max_occupancy_, occupancy_);
+        occupancy_sum_ += occupancy_;
+        ++pushes_;
+
+        if(releasing_) {
+            return;
+        }
+        releasing_ = true;
+        while(filled_[index(next_)]) {
+            std::size_t next_slot = index(next_);
+            T ready = std::move(values_[next_slot]);
+            filled_[next_slot] = false;
+
+            // The consumer runs without the lock, releasing_ keeps other threads from releasing out of order
+            lock.unlock();
+            consumer_(next_, std::move(ready));
+            lock.lock();
+
+            ++next_;
+            --occupancy_;
+            space_.notify_all();
+        }
+        releasing_ = false;
+        drained_.notify_all();
+    }
+
+    /**
+     * @brief Block until all results before the given sequence number have been released
+     */
+    void wait_until(std::int64_t sequence) {
+        std::unique_lock<std::mutex> lock{mutex_};
+        drained_.wait(lock, [this, sequence]() { return next_ >= sequence && !releasing_; });
+    }
+
+    /**
+     * @brief Return the sequence number of the next result to be released
+     */
+    std::int64_t next() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return next_;
+    }
+
+    /**
+     * @brief Return the occupancy of the reorder buffer and how often producers were throttled
+     */
+    Statistics statistics() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return {max_occupancy_, pushes_ > 0 ? static_cast<double>(occupancy_sum_) / static_cast<double>(pushes_) : 0.,
+                throttled_, throttled_seconds_};
+    }
+
+private:
+    bool fits(std::int64_t sequence) const { return sequence < next_ + static_cast<std::int64_t>(window_); }
+
+    // Sequence numbers within the window map to distinct slots
+    std::size_t index(std::int64_t sequence) const { return static_cast<std::size_t>(sequence - first_) % window_; }
+
+    std::int64_t first_;
+    std::int64_t next_;
+    std::size_t window_;
+    Consumer consumer_;
+
+    std::vector<T> values_;
+    std::vector<bool> filled_;
+    bool releasing_{false};
+
+    std::size_t occupancy_{0};
+    std::size_t max_occupancy_{0};
+    std::uint64_t occupancy_sum_{0};
+    std::uint64_t pushes_{0};
+    std::uint64_t throttled_{0};
+    double throttled_seconds_{0};
+
+    mutable std::mutex mutex_;
+    std::condition_variable space_;
+    std::condition_variable drained_;
+};
+
+#endif
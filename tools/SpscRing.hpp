@@ -0,0 +1,112 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Bounded lock-free queue between exactly one producer thread and one consumer thread
+ *
+ * All slots are constructed up front and reused, the producer writes into a slot in place and publishes it with a single
+ * release store. Objects keeping their own storage, such as vectors, therefore keep their capacity between uses and
+ * the queue does not allocate after warm-up. The producer and consumer indices live on separate cache lines, each side
+ * caches the index of the other side and only reloads it when the queue looks full or empty.
+ */
+template <typename T> class SpscRing {
+public:
+    /**
+     * @brief Constructs the queue
+     * @param capacity Minimum number of elements, rounded up to a power of two
+     */
+    explicit SpscRing(std::size_t capacity) : slots_(round_up(capacity)), mask_(slots_.size() - 1) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * @brief Return the next free slot to write into or nullptr if the queue is full, only called by the producer
+     *
+     * The slot still holds the element previously stored in it. It is only published by calling commit().
+     */
+    T* try_acquire() {
+        std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail - head_cache_ == slots_.size()) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if(tail - head_cache_ == slots_.size()) {
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    /**
+     * @brief Publish the slot returned by the last try_acquire() to the consumer
+     */
+    void commit() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /**
+     * @brief Copy an element into the queue, only called by the producer
+     * @return False if the queue is full
+     */
+    bool try_push(const T& value) {
+        T* slot = try_acquire();
+        if(slot == nullptr) {
+            return false;
+        }
+        *slot = value;
+        commit();
+        return true;
+    }
+
+    /**
+     * @brief Return the oldest element or nullptr if the queue is empty, only called by the consumer
+     */
+    T* front() {
+        std::size_t head = head_.load(std::memory_order_relaxed);
+        if(head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if(head == tail_cache_) {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    /**
+     * @brief Release the element returned by front() back to the producer
+     */
+    void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /**
+     * @brief Return the number of queued elements, only a snapshot if called while the queue is in use
+     */
+    std::size_t size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Return the maximum number of queued elements
+     */
+    std::size_t capacity() const { return slots_.size(); }
+
+private:
+    static std::size_t round_up(std::size_t capacity) {
+        std::size_t size = 1;
+        while(size < capacity) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    std::vector<T> slots_;
+    std::size_t mask_;
+
+    // Consumer side
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_{0};
+
+    // Producer side
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    std::size_t head_cache_{0};
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef SUBEVENT_H
+#define SUBEVENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Slice of a logical event simulated as a sub-event on the calling thread
+ *
+ * The primaries of a logical event are split evenly into count slices, every slice is simulated as an event of its
+ * own and can run on a different thread. The slice a thread is simulating is kept in a thread-local context, so the
+ * seeding of the worker, the primary generator and the hit collection can pick it up without passing it through
+ * Geant4.
+ */
+struct SubEventSlice {
+    std::int64_t event{0};
+    std::uint32_t index{0};
+    std::uint32_t count{1};
+    bool active{false};
+
+    /**
+     * @brief Return the range [first, last) of the items belonging to this slice
+     * @param items Number of items of the whole event, e.g. its primaries
+     */
+    std::pair<std::size_t, std::size_t> range(std::size_t items) const {
+        return {items * index / count, items * (index + 1) / count};
+    }
+
+    /**
+     * @brief Return the slice simulated on the calling thread, inactive outside of a SubEventScope
+     */
+    static SubEventSlice& current() {
+        static thread_local SubEventSlice slice;
+        return slice;
+    }
+};
+
+/**
+ * @brief Makes a slice the current one of the calling thread for its lifetime
+ */
+class SubEventScope {
+public:
+    SubEventScope(std::int64_t event, std::uint32_t index, std::uint32_t count) : saved_(SubEventSlice::current()) {
+        SubEventSlice::current() = {event, index, count, true};
+    }
+    ~SubEventScope() { SubEventSlice::current() = saved_; }
+
+    SubEventScope(const SubEventScope&) = delete;
+    SubEventScope& operator=(const SubEventScope&) = delete;
+
+private:
+    SubEventSlice saved_;
+};
+
+/**
+ * @brief Collects the results of the sub-events of every logical event and hands them on once all have arrived
+ *
+ * Sub-events of different events can arrive interleaved and from any thread. The parts of an event are handed to the
+ * consumer in slice order, independent of the order they finished in, on the thread adding the last part.
+ */
+template <typename T> class SubEventMerger {
+public:
+    /**
+     * @brief Function receiving the parts of a complete event, ordered by slice index
+     */
+    using Consumer = std::function<void(std::int64_t event, std::vector<T>&& parts)>;
+
+    /**
+     * @brief Constructs the merger
+     * @param consumer Function receiving the parts of every complete event, must be safe to call from several threads
+     */
+    explicit SubEventMerger(Consumer consumer) : consumer_(std::move(consumer)) {}
+
+    SubEventMerger(const SubEventMerger&) = delete;
+    SubEventMerger& operator=(const SubEventMerger&) = delete;
+
+    /**
+     * @brief Add the result of a sub-event
+     * @param event Logical event the sub-event belongs to
+     * @param index Slice index of the sub-event
+     * @param count Number of sub-events of the logical event
+     * @param part Result of the sub-event
+     */
+    void add(std::int64_t event, std::uint32_t index, std::uint32_t count, T part) {
+        std::vector<T> parts;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            Pending& pending = pending_[event];
+            if(pending.parts.empty()) {
+                pending.parts.resize(count);
+            }
+            pending.parts[index] = std::move(part);
+            if(++pending.received < count) {
+                return;
+            }
+            parts = std::move(pending.parts);
+            pending_.erase(event);
+        }
+        consumer_(event, std::move(parts));
+    }
+
+    /**
+     * @brief Return the number of events waiting for some of their sub-events
+     */
+    std::size_t pending() const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return pending_.size();
+    }
+
+private:
+    struct Pending {
+        std::vector<T> parts;
+        std::uint32_t received{0};
+    };
+
+    Consumer consumer_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::int64_t, Pending> pending_;
+};
+
+#endif
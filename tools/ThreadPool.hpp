@@ -1,76 +1,271 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "CountdownLatch.hpp"
+#include "CpuTopology.hpp"
+#include "Instrumentation.hpp"
+
+/**
+ * @brief Work-stealing pool of threads executing submitted tasks
+ *
+ * Every worker owns a task queue. Tasks submitted from outside the pool are distributed round-robin over the queues,
+ * tasks submitted from a worker go to its own queue. A worker takes tasks from its own queue first and steals from a
+ * randomly chosen victim when it runs dry, so workers only contend on the same lock when stealing. Idle workers park on
+ * a single condition variable and are only notified when somebody is actually parked.
+ *
+ * The number of threads can be changed while the pool is running with resize(). The queues of all threads the pool can
+ * ever have are created up front, so workers never see the set of queues change while they steal.
+ */
 class ThreadPool {
 public:
     /**
-     * @brief Internal thread-safe queue
+     * @brief Move-only type-erased callable with inline storage
+     *
+     * Callables up to \ref Task::inline_size bytes are stored inside the task itself, so wrapping them does not allocate.
+     * Larger callables fall back to a single heap allocation.
      */
-    template <typename T> class SafeQueue {
+    class Task {
     public:
         /**
-         * @brief Default constructor, initializes empty queue
+         * @brief Size of the inline storage in bytes
          */
-        SafeQueue() = default;
+        static constexpr std::size_t inline_size = 64;
 
         /**
-         * @brief Erases the queue and release waiting threads on destruction
+         * @brief Constructs an empty task
          */
-        ~SafeQueue() { invalidate(); };
+        Task() = default;
 
         /**
-         * @brief Get the top value in the safe queue
-         * @param out Reference where the value at the top of the queue will be written to
-         * @param wait If the method should wait for new tasks or should exit (defaults to wait)
-         * @param func Optional function to execute before releasing the queue mutex if pop was successful
-         * @return True if a task was acquired or false if pop was exited for another reason
+         * @brief Constructs a task wrapping the given callable
+         * @param func Callable without arguments, its result is discarded
          */
-        bool pop(T& out, bool wait = true, const std::function<void()>& func = nullptr) {
-            // Lock the mutex
-            std::unique_lock<std::mutex> lock{mutex_};
-            if(wait) {
-                // Wait for new item in the queue (unlocks the mutex while waiting)
-                condition_.wait(lock, [this]() { return !queue_.empty() || !valid_; });
-            }
-            // Check for empty and valid queue
-            if(queue_.empty() || !valid_) {
-                return false;
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Task>::value>::type>
+        Task(F&& func) {
+            emplace<typename std::decay<F>::type>(std::forward<F>(func));
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        Task(Task&& other) noexcept { move_from(other); }
+        Task& operator=(Task&& other) noexcept {
+            if(this != &other) {
+                reset();
+                move_from(other);
             }
+            return *this;
+        }
 
-            // Pop the queue and optionally execute the mutex protected function
-            out = std::move(queue_.front());
-            queue_.pop();
-            if(func != nullptr) {
-                func();
+        ~Task() { reset(); }
+
+        /**
+         * @brief Execute the wrapped callable
+         */
+        void operator()() { vtable_->invoke(storage_); }
+
+        /**
+         * @brief Return if the task wraps a callable
+         */
+        explicit operator bool() const { return vtable_ != nullptr; }
+
+        /**
+         * @brief Destroy the wrapped callable, leaving an empty task
+         */
+        void reset() {
+            if(vtable_ != nullptr) {
+                vtable_->destroy(storage_);
+                vtable_ = nullptr;
+            }
+        }
+
+    private:
+        struct VTable {
+            void (*invoke)(void*);
+            void (*move)(void*, void*);
+            void (*destroy)(void*);
+        };
+
+        // Callables stored in place
+        template <typename F> struct InlineOps {
+            static void invoke(void* storage) { (*static_cast<F*>(storage))(); }
+            static void move(void* dst, void* src) {
+                new(dst) F(std::move(*static_cast<F*>(src)));
+                static_cast<F*>(src)->~F();
+            }
+            static void destroy(void* storage) { static_cast<F*>(storage)->~F(); }
+            static const VTable* vtable() {
+                static const VTable table{&invoke, &move, &destroy};
+                return &table;
             }
-            return true;
         };
 
+        // Callables too large for the inline storage, only the pointer is stored in place
+        template <typename F> struct HeapOps {
+            static F*& pointer(void* storage) { return *static_cast<F**>(storage); }
+            static void invoke(void* storage) { (*pointer(storage))(); }
+            static void move(void* dst, void* src) {
+                new(dst) F*(pointer(src));
+                pointer(src) = nullptr;
+            }
+            static void destroy(void* storage) { delete pointer(storage); }
+            static const VTable* vtable() {
+                static const VTable table{&invoke, &move, &destroy};
+                return &table;
+            }
+        };
+
+        template <typename F>
+        using fits_inline = std::integral_constant<bool,
+                                                   sizeof(F) <= inline_size && alignof(std::max_align_t) % alignof(F) == 0 &&
+                                                       std::is_nothrow_move_constructible<F>::value>;
+
+        template <typename F, typename G> void emplace(G&& func) { emplace<F>(std::forward<G>(func), fits_inline<F>()); }
+        template <typename F, typename G> void emplace(G&& func, std::true_type) {
+            new(storage_) F(std::forward<G>(func));
+            vtable_ = InlineOps<F>::vtable();
+        }
+        template <typename F, typename G> void emplace(G&& func, std::false_type) {
+            new(storage_) F*(new F(std::forward<G>(func)));
+            vtable_ = HeapOps<F>::vtable();
+        }
+
+        void move_from(Task& other) {
+            if(other.vtable_ != nullptr) {
+                other.vtable_->move(storage_, other.storage_);
+                vtable_ = other.vtable_;
+                other.vtable_ = nullptr;
+            }
+        }
+
+        alignas(std::max_align_t) unsigned char storage_[inline_size];
+        const VTable* vtable_{nullptr};
+    };
+
+    /**
+     * @brief Policy pinning the pool threads to CPUs
+     *
+     * Threads are pinned when they start, before they execute any task, so all per-thread state created by tasks is
+     * first touched on the NUMA node of the CPU the thread is pinned to.
+     */
+    struct Placement {
+        enum class Policy {
+            // Threads are scheduled freely by the operating system
+            None,
+            // Consecutive threads fill the CPUs of one node before moving to the next
+            Compact,
+            // Consecutive threads alternate between the nodes
+            Scatter,
+            // Threads are pinned to the listed CPUs in order
+            List
+        };
+
+        Policy policy{Policy::None};
+        std::vector<int> cpus;
+
         /**
-         * @brief Push a new value onto the safe queue
+         * @brief Parse a placement from "none", "compact", "scatter" or an explicit CPU list such as "0,2,4-7"
+         * @param value Placement description
+         */
+        static Placement parse(const std::string& value) {
+            Placement placement;
+            if(value == "compact") {
+                placement.policy = Policy::Compact;
+            } else if(value == "scatter") {
+                placement.policy = Policy::Scatter;
+            } else if(!value.empty() && value != "none") {
+                placement.policy = Policy::List;
+                placement.cpus = CpuTopology::parse_list(value);
+            }
+            return placement;
+        }
+    };
+
+    /**
+     * @brief Location of a pool thread after applying the placement
+     */
+    struct ThreadLocation {
+        std::size_t index;
+        int cpu;
+        int node;
+        bool pinned;
+    };
+
+    /**
+     * @brief Internal task queue of a single worker
+     *
+     * Implemented as a growing ring buffer, so pushing and popping does not allocate once the queue has reached its
+     * working size.
+     */
+    template <typename T> class WorkQueue {
+    public:
+        /**
+         * @brief Default constructor, initializes empty queue
+         */
+        WorkQueue() : buffer_(16) {}
+
+        /**
+         * @brief Push a new value to the back of the queue
          * @param value Value to push to the queue
          */
         void push(T value) {
             std::lock_guard<std::mutex> lock{mutex_};
-            queue_.push(std::move(value));
-            condition_.notify_one();
+            if(size_ == buffer_.size()) {
+                grow();
+            }
+            buffer_[(head_ + size_) & (buffer_.size() - 1)] = std::move(value);
+            ++size_;
+        };
+
+        /**
+         * @brief Take the oldest value from the queue, used by the owning worker
+         * @param out Reference where the value at the front of the queue will be written to
+         * @return True if a value was taken or false if the queue is empty
+         */
+        bool pop(T& out) {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if(size_ == 0) {
+                return false;
+            }
+            out = std::move(buffer_[head_]);
+            head_ = (head_ + 1) & (buffer_.size() - 1);
+            --size_;
+            return true;
         };
 
         /**
-         * @brief Return if the queue is in a valid state
-         * @return True if the queue is valid, false if \ref SafeQueue::invalidate has been called
+         * @brief Take the newest value from the queue, used by other workers stealing work
+         * @param out Reference where the value at the back of the queue will be written to
+         * @return True if a value was taken or false if the queue is empty
          */
-        bool isValid() const {
+        bool steal(T& out) {
             std::lock_guard<std::mutex> lock{mutex_};
-            return valid_;
+            if(size_ == 0) {
+                return false;
+            }
+            out = std::move(buffer_[(head_ + size_ - 1) & (buffer_.size() - 1)]);
+            --size_;
+            return true;
         };
 
         /**
@@ -79,50 +274,98 @@ public:
          */
         bool empty() const {
             std::lock_guard<std::mutex> lock{mutex_};
-            return !valid_ || queue_.empty();
+            return size_ == 0;
         };
 
         /**
-         * @brief Invalidate the queue
+         * @brief Drop all values in the queue
          */
-        void invalidate(){
+        void clear() {
             std::lock_guard<std::mutex> lock{mutex_};
-            std::queue<T>().swap(queue_);
-            valid_ = false;
-            condition_.notify_all();
+            for(std::size_t i = 0; i < size_; ++i) {
+                buffer_[(head_ + i) & (buffer_.size() - 1)] = T();
+            }
+            head_ = 0;
+            size_ = 0;
         };
 
     private:
-        std::atomic_bool valid_{true};
+        // Double the capacity, keeping the capacity a power of two
+        void grow() {
+            std::vector<T> larger(buffer_.size() * 2);
+            for(std::size_t i = 0; i < size_; ++i) {
+                larger[i] = std::move(buffer_[(head_ + i) & (buffer_.size() - 1)]);
+            }
+            buffer_.swap(larger);
+            head_ = 0;
+        }
+
         mutable std::mutex mutex_;
-        std::queue<T> queue_;
-        std::condition_variable condition_;
+        std::vector<T> buffer_;
+        std::size_t head_{0};
+        std::size_t size_{0};
     };
 
 private:
+    // Callable with its arguments bound, invoked without arguments
+    template <typename F, typename... Args> class BoundCall {
+    public:
+        template <typename G, typename... BoundArgs>
+        explicit BoundCall(G&& func, BoundArgs&&... args)
+            : func_(std::forward<G>(func)), args_(std::forward<BoundArgs>(args)...) {}
+
+        auto operator()() -> decltype(std::declval<F&>()(std::declval<Args&>()...)) {
+            return call(std::index_sequence_for<Args...>());
+        }
+
+    private:
+        template <std::size_t... I> auto call(std::index_sequence<I...>) -> decltype(std::declval<F&>()(std::declval<Args&>()...)) {
+            return func_(std::get<I>(args_)...);
+        }
+
+        F func_;
+        std::tuple<Args...> args_;
+    };
+
+    template <typename F, typename... Args>
+    static BoundCall<typename std::decay<F>::type, typename std::decay<Args>::type...> bind_call(F&& f, Args&&... args) {
+        return BoundCall<typename std::decay<F>::type, typename std::decay<Args>::type...>(std::forward<F>(f),
+                                                                                           std::forward<Args>(args)...);
+    }
+
     class ThreadWorker {
     private:
         ThreadPool* pool_;
+        std::size_t index_;
+        CountdownLatch* placed_;
 
     public:
-        ThreadWorker(ThreadPool* pool) : pool_(pool) {}
+        ThreadWorker(ThreadPool* pool, std::size_t index, CountdownLatch* placed) : pool_(pool), index_(index), placed_(placed) {}
 
         void operator()() {
-            std::function<void()> func;
-            bool dequeued;
-            while(!pool_->shutdown_) {
-                {
-                    std::unique_lock<std::mutex> lock(pool_->conditional_mutex_);
-                    if(pool_->queue_.empty()) {
-                        pool_->conditional_lock_.wait(lock);
-                    }
-                    dequeued = pool_->queue_.pop(func);
-                }
-                if(dequeued) {
+            // Register this thread as worker of the pool so submissions from tasks go to its own queue
+            current_worker() = {pool_, index_};
+
+            // Pin the thread before it runs any task
+            pool_->place_thread(index_);
+            placed_->count_down();
+
+            Task func;
+            while(!pool_->shutdown_ && !pool_->retiring_[index_]) {
+                if(pool_->next_task(index_, func)) {
+                    INSTRUMENT_SCOPE(TaskExecution);
                     func();
+                    func.reset();
+                } else {
+                    pool_->park(index_);
                 }
             }
 
+            // A thread removed by resize finishes the tasks already queued to it
+            if(!pool_->shutdown_) {
+                pool_->drain(index_);
+            }
+
             // Cleanup all thread local stuff
             if (pool_->thread_cleanup_func_) {
                 pool_->thread_cleanup_func_();
@@ -130,19 +373,233 @@ private:
         }
     };
 
-    bool shutdown_;
-    ThreadPool::SafeQueue<std::function<void()>> queue_;
+    // Pool and queue index of the worker running on the calling thread
+    struct WorkerContext {
+        const ThreadPool* pool;
+        std::size_t index;
+    };
+
+    static WorkerContext& current_worker() {
+        static thread_local WorkerContext context{nullptr, 0};
+        return context;
+    }
+
+    // Pin the calling pool thread according to the placement policy and record where it ended up
+    void place_thread(std::size_t index) {
+        ThreadLocation location{index, -1, -1, false};
+        if(!cpu_order_.empty()) {
+            location.pinned = CpuTopology::pin_current_thread(cpu_order_[index % cpu_order_.size()]);
+        }
+        location.cpu = CpuTopology::current_cpu();
+        location.node = topology_.node_of(location.cpu);
+        locations_[index] = location;
+    }
+
+    // Take a task from the own queue or steal it from another worker
+    bool next_task(std::size_t index, Task& out) {
+        // Tasks bound to this thread come first, they are never stolen
+        if(next_own_task(index, out)) {
+            return true;
+        }
+
+        // Start at a random victim to spread thieves over the queues. Queues of threads removed by resize are
+        // included, tasks pushed there while the thread retired are picked up by the others
+        std::size_t n_queues = queues_in_use_.load();
+        std::size_t victim = random_index(n_queues);
+        for(std::size_t i = 0; i < n_queues; ++i, victim = (victim + 1) % n_queues) {
+            if(victim != index && queues_[victim]->steal(out)) {
+                task_dequeued();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Execute the tasks left in the own queues of a retiring thread, including the ones they submit
+    void drain(std::size_t index) {
+        Task func;
+        while(next_own_task(index, func)) {
+            INSTRUMENT_SCOPE(TaskExecution);
+            func();
+            func.reset();
+        }
+    }
+
+    // Take a task from the own queues only
+    bool next_own_task(std::size_t index, Task& out) {
+        if(thread_queues_[index]->pop(out)) {
+            return true;
+        }
+        if(queues_[index]->pop(out)) {
+            task_dequeued();
+            return true;
+        }
+        return false;
+    }
+
+    // Start the threads with the given indices and wait until all of them are placed
+    void start_threads(std::size_t first, std::size_t last) {
+        // The new queues have to be visible to thieves before the threads take tasks
+        if(queues_in_use_.load() < last) {
+            queues_in_use_ = last;
+        }
+        CountdownLatch placed(last - first);
+        for(std::size_t i = first; i < last; ++i) {
+            retiring_[i] = false;
+            threads_[i] = std::thread(ThreadWorker(this, i, &placed));
+        }
+        placed.wait();
+    }
+
+    // Release the queue slot of a task and wake up a submitter waiting for space if any
+    void task_dequeued() {
+        pending_.fetch_sub(1);
+        if(blocked_.load() > 0) {
+            std::lock_guard<std::mutex> lock(space_mutex_);
+            space_cv_.notify_one();
+        }
+    }
+
+    // Whether a task can be queued without exceeding the capacity. Pool threads never wait, they
+    // would block the threads that have to drain the queue.
+    bool has_space() const {
+        std::size_t capacity = capacity_.load();
+        return capacity == 0 || pending_.load() < capacity || current_worker().pool == this || shutdown_;
+    }
+
+    // Throw if the pool has been shut down, a task queued now would never run
+    void check_running() const {
+        if(shutdown_) {
+            throw std::runtime_error("cannot submit tasks to a thread pool that has been shut down");
+        }
+    }
+
+    // Wait until a task can be queued, returns false if the deadline passed first. Waits without
+    // limit if no deadline is given. Also returns once the pool shuts down, the caller has to
+    // check for that before queuing.
+    bool wait_for_space(const std::chrono::steady_clock::time_point* deadline) {
+        if(has_space()) {
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(space_mutex_);
+        // Same protocol as parking: a worker dequeuing a task either sees the waiter or its
+        // dequeue is seen by the predicate
+        blocked_.fetch_add(1);
+        bool space = true;
+        if(deadline != nullptr) {
+            space = space_cv_.wait_until(lock, *deadline, [this]() { return has_space(); });
+        } else {
+            space_cv_.wait(lock, [this]() { return has_space(); });
+        }
+        blocked_.fetch_sub(1);
+        return space;
+    }
+
+    // Wait until tasks are pending or the pool shuts down
+    void park(std::size_t index) {
+        INSTRUMENT_SCOPE(QueueWait);
+        std::unique_lock<std::mutex> lock(park_mutex_);
+        // Announce the sleeper before checking for work, a submitter either sees the sleeper and notifies or its task
+        // is seen here, so no wakeup is lost
+        idle_.fetch_add(1);
+        park_cv_.wait(lock, [this, index]() {
+            return pending_.load() > 0 || !thread_queues_[index]->empty() || shutdown_ || retiring_[index];
+        });
+        idle_.fetch_sub(1);
+    }
+
+    // Push a task to a worker queue and wake up a parked worker if any
+    void enqueue(Task task) {
+        const WorkerContext& context = current_worker();
+        std::size_t index = (context.pool == this ? context.index : next_queue_.fetch_add(1) % n_threads_.load());
+        queues_[index]->push(std::move(task));
+
+        pending_.fetch_add(1);
+        if(idle_.load() > 0) {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            park_cv_.notify_one();
+        }
+    }
+
+    // Push a task that has to run on the given pool thread and wake up all parked workers
+    void enqueue_to(std::size_t index, Task task) {
+        thread_queues_[index]->push(std::move(task));
+
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        park_cv_.notify_all();
+    }
+
+    // Thread local xorshift generator to select steal victims
+    static std::size_t random_index(std::size_t n) {
+        static thread_local std::uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state % n;
+    }
+
+    std::atomic_bool shutdown_;
+    // Maximum number of threads, the queues, threads and flags below have one entry per possible thread
+    std::size_t max_threads_;
+    std::vector<std::unique_ptr<ThreadPool::WorkQueue<ThreadPool::Task>>> queues_;
+    std::vector<std::unique_ptr<ThreadPool::WorkQueue<ThreadPool::Task>>> thread_queues_;
     std::vector<std::thread> threads_;
-    std::mutex conditional_mutex_;
-    std::condition_variable conditional_lock_;
+    std::unique_ptr<std::atomic_bool[]> retiring_;
+    // Number of running threads, and number of queues that ever had a thread
+    std::atomic<std::size_t> n_threads_{0};
+    std::atomic<std::size_t> queues_in_use_{0};
+    std::mutex resize_mutex_;
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> idle_{0};
+    std::atomic<std::size_t> next_queue_{0};
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+
+    // Maximum number of queued tasks, zero for an unbounded queue
+    std::atomic<std::size_t> capacity_{0};
+    std::atomic<std::size_t> blocked_{0};
+    std::mutex space_mutex_;
+    std::condition_variable space_cv_;
     std::function<void()> thread_cleanup_func_;
 
+    CpuTopology topology_;
+    std::vector<int> cpu_order_;
+    std::vector<ThreadLocation> locations_;
+
 public:
     ThreadPool(const unsigned int n_threads, std::function<void()> thread_cleanup_func)
-        : shutdown_(false), threads_(std::vector<std::thread>(n_threads)), thread_cleanup_func_(thread_cleanup_func) {
-        for(auto& thread : threads_) {
-            thread = std::thread(ThreadWorker(this));
+        : ThreadPool(n_threads, std::move(thread_cleanup_func), Placement()) {}
+
+    // The pool can be resized up to max_threads threads, by default the larger of n_threads and the number of CPUs
+    ThreadPool(const unsigned int n_threads, std::function<void()> thread_cleanup_func, const Placement& placement,
+               std::size_t max_threads = 0)
+        : shutdown_(false), max_threads_(std::max<std::size_t>({max_threads, n_threads, std::thread::hardware_concurrency(), 1})),
+          threads_(max_threads_), retiring_(new std::atomic_bool[max_threads_]), thread_cleanup_func_(thread_cleanup_func),
+          topology_(CpuTopology::detect()), locations_(max_threads_) {
+        // Tasks submitted from outside are distributed over the threads, there has to be at least one
+        if(n_threads == 0) {
+            throw std::invalid_argument("thread pool size has to be between 1 and " + std::to_string(max_threads_));
         }
+
+        // All queues have to exist before the first worker starts stealing
+        for(std::size_t i = 0; i < max_threads_; ++i) {
+            queues_.push_back(std::make_unique<ThreadPool::WorkQueue<ThreadPool::Task>>());
+            thread_queues_.push_back(std::make_unique<ThreadPool::WorkQueue<ThreadPool::Task>>());
+            retiring_[i] = false;
+        }
+
+        if(placement.policy == Placement::Policy::Compact) {
+            cpu_order_ = topology_.compact_order();
+        } else if(placement.policy == Placement::Policy::Scatter) {
+            cpu_order_ = topology_.scatter_order();
+        } else if(placement.policy == Placement::Policy::List) {
+            cpu_order_ = placement.cpus;
+        }
+
+        // Wait for all threads to be placed so the placement can be reported
+        start_threads(0, n_threads);
+        n_threads_ = n_threads;
     }
 
     ThreadPool(const ThreadPool&) = delete;
@@ -151,37 +608,194 @@ public:
     ThreadPool& operator=(const ThreadPool&) = delete;
     ThreadPool& operator=(ThreadPool&&) = delete;
 
+    ~ThreadPool() { shutdown(); }
+
+    // Location of every pool thread after applying the placement policy
+    std::vector<ThreadLocation> placement() const {
+        return std::vector<ThreadLocation>(locations_.begin(), locations_.begin() + static_cast<std::ptrdiff_t>(size()));
+    }
+
+    // Human readable report of the thread placement
+    std::string placement_report() const {
+        std::stringstream report;
+        for(const auto& location : placement()) {
+            report << "thread " << location.index << ": cpu " << location.cpu << " node " << location.node
+                   << (location.pinned ? " (pinned)" : " (unpinned)") << "\n";
+        }
+        return report.str();
+    }
+
     // Waits until threads finish their current task and shutdowns the pool
     void shutdown() {
-        shutdown_ = true;
-        conditional_lock_.notify_all();
-        queue_.invalidate();
+        {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            shutdown_ = true;
+            park_cv_.notify_all();
+        }
+        {
+            // Release submitters waiting for space, they fail instead of queuing their task
+            std::lock_guard<std::mutex> lock(space_mutex_);
+            space_cv_.notify_all();
+        }
+
+        {
+            // Threads of a concurrent resize are joined by resize itself
+            std::lock_guard<std::mutex> lock(resize_mutex_);
+            for(auto& thrd : threads_) {
+                if(thrd.joinable()) {
+                    thrd.join();
+                }
+            }
+        }
+
+        // Drop the tasks that were never started
+        for(auto& queue : queues_) {
+            queue->clear();
+        }
+        for(auto& queue : thread_queues_) {
+            queue->clear();
+        }
+        pending_ = 0;
+    }
+
+    // Change the number of threads to n while the pool keeps running, n has to be in [1, max_threads()].
+    // Added threads are placed like the initial ones and pick up queued tasks right away. Removed threads
+    // stop taking new tasks, finish the tasks already queued to them, call the thread cleanup function
+    // and are joined before this returns. Must not be called from a pool thread or concurrently with
+    // for_each_thread.
+    void resize(std::size_t n) {
+        if(n == 0 || n > max_threads_) {
+            throw std::invalid_argument("thread pool size has to be between 1 and " + std::to_string(max_threads_));
+        }
+        std::lock_guard<std::mutex> lock(resize_mutex_);
+        if(shutdown_) {
+            return;
+        }
 
-        for(auto& thrd : threads_) {
-            if(thrd.joinable()) {
-                thrd.join();
+        std::size_t current = n_threads_.load();
+        if(n > current) {
+            start_threads(current, n);
+            n_threads_ = n;
+        } else if(n < current) {
+            // Submissions only go to the remaining threads from now on
+            n_threads_ = n;
+            {
+                std::lock_guard<std::mutex> park_lock(park_mutex_);
+                for(std::size_t i = n; i < current; ++i) {
+                    retiring_[i] = true;
+                }
+                park_cv_.notify_all();
+            }
+            for(std::size_t i = n; i < current; ++i) {
+                threads_[i].join();
             }
         }
     }
 
-    // Submit a function to be executed asynchronously by the pool
+    // Maximum number of threads the pool can be resized to
+    std::size_t max_threads() const { return max_threads_; }
+
+    // Limit the number of queued tasks that have not been started yet, zero removes the limit.
+    // Submitting from outside the pool blocks while the queue is full, so memory stays flat however
+    // many tasks are scheduled. Tasks submitted by pool threads and for_each_thread are always
+    // accepted. Concurrent submitters can exceed the capacity by one task each.
+    void set_capacity(std::size_t capacity) {
+        capacity_ = capacity;
+        std::lock_guard<std::mutex> lock(space_mutex_);
+        space_cv_.notify_all();
+    }
+
+    // Maximum number of queued tasks, zero if the queue is unbounded
+    std::size_t capacity() const { return capacity_.load(); }
+
+    // Submit a function to be executed asynchronously by the pool, waits while the queue is full.
+    // Throws std::runtime_error if the pool has been shut down.
     template <typename F, typename... Args> auto submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
-        // Create a function with bounded parameters ready to execute
-        std::function<decltype(f(args...))()> func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-        // Encapsulate it into a shared ptr in order to be able to copy construct / assign
-        auto task_ptr = std::make_shared<std::packaged_task<decltype(f(args...))()>>(func);
+        wait_for_space(nullptr);
+        check_running();
+        return submit_task(std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    // Submit a function if the queue has space within the timeout. Returns an invalid future
+    // (valid() is false) if the queue stayed full or the pool has been shut down.
+    template <typename Rep, typename Period, typename F, typename... Args>
+    auto submit_for(const std::chrono::duration<Rep, Period>& timeout, F&& f, Args&&... args)
+        -> std::future<decltype(f(args...))> {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        if(!wait_for_space(&deadline) || shutdown_) {
+            return {};
+        }
+        return submit_task(std::forward<F>(f), std::forward<Args>(args)...);
+    }
 
-        // Wrap packaged task into void function
-        std::function<void()> wrapper_func = [task_ptr]() { (*task_ptr)(); };
+    // Submit a function only if the queue is not full, never blocks. Returns an invalid future
+    // (valid() is false) if the queue is full or the pool has been shut down.
+    template <typename F, typename... Args> auto try_submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        if(!has_space() || shutdown_) {
+            return {};
+        }
+        return submit_task(std::forward<F>(f), std::forward<Args>(args)...);
+    }
 
-        // Enqueue generic wrapper function
-        queue_.push(wrapper_func);
+private:
+    template <typename F, typename... Args> auto submit_task(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+        // Bind the parameters and wrap the call into a task providing the future, the task is moved
+        // into the queue and only its shared state is allocated
+        std::packaged_task<decltype(f(args...))()> task(bind_call(std::forward<F>(f), std::forward<Args>(args)...));
+        auto future = task.get_future();
 
-        // Wake up one thread if its waiting
-        conditional_lock_.notify_one();
+        // Enqueue task and wake up a thread if one is waiting
+        enqueue(Task(std::move(task)));
 
         // Return future from promise
-        return task_ptr->get_future();
+        return future;
+    }
+
+public:
+    // Submit a function to be executed asynchronously by the pool without tracking its result.
+    // Small functions are stored inline in the queue and do not allocate. The function should not throw.
+    // Waits while the queue is full. Throws std::runtime_error if the pool has been shut down.
+    template <typename F, typename... Args> void submit_detached(F&& f, Args&&... args) {
+        wait_for_space(nullptr);
+        check_running();
+        enqueue(Task(bind_call(std::forward<F>(f), std::forward<Args>(args)...)));
+    }
+
+    // Execute f once on every pool thread and wait until all of them finished. The threads
+    // run f concurrently. Must not be called from a pool thread. Throws std::runtime_error if
+    // the pool has been shut down.
+    template <typename F> void for_each_thread(F f) {
+        check_running();
+        std::size_t n_threads = size();
+        CountdownLatch done(n_threads);
+        for(std::size_t i = 0; i < n_threads; ++i) {
+            enqueue_to(i, Task([f, &done]() mutable {
+                f();
+                done.count_down();
+            }));
+        }
+        done.wait();
+    }
+
+    // Number of threads in the pool
+    std::size_t size() const { return n_threads_.load(); }
+
+    // Number of submitted tasks that have not been picked up by a thread yet, excluding per-thread tasks
+    std::size_t queue_depth() const { return pending_.load(std::memory_order_relaxed); }
+
+    // Submit count executions of f(i) for i in [0, count) and count down the latch after each of them.
+    // The latch has to be counted down count times before waiting on it releases. Waits for space
+    // before every task while the queue is full. Throws std::runtime_error if the pool has been
+    // shut down, the executions submitted before keep their count on the latch.
+    template <typename F> void submit_bulk(std::size_t count, F f, CountdownLatch& latch) {
+        for(std::size_t i = 0; i < count; ++i) {
+            wait_for_space(nullptr);
+            check_running();
+            enqueue(Task([f, i, &latch]() mutable {
+                f(i);
+                latch.count_down();
+            }));
+        }
     }
 };
 